@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "CpuFeatures.h"
+#include <intrin.h>
+#include <immintrin.h>
+#include <cctype>
+
+namespace
+{
+	//Feature bits of the cpuid leaves used below
+	constexpr int LEAF1_ECX_SSE41{ 1 << 19 };
+	constexpr int LEAF1_ECX_OSXSAVE{ 1 << 27 };
+	constexpr int LEAF1_ECX_AVX{ 1 << 28 };
+	constexpr int LEAF7_EBX_AVX2{ 1 << 5 };
+	constexpr int LEAF7_EBX_AVX512F{ 1 << 16 };
+	constexpr int LEAF7_EBX_AVX512VL{ 1 << 31 };
+
+	//Register state the OS saves on a context switch (XCR0): SSE + AVX, and the AVX-512 mask and upper ZMM registers on top
+	constexpr unsigned long long XCR0_AVX_STATE{ 0x06 };
+	constexpr unsigned long long XCR0_AVX512_STATE{ 0xE6 };
+
+	//cpuid is only asked once, the answer doesn't change while running
+	struct CpuInfo
+	{
+		int leaf1Ecx{};
+		int leaf7Ebx{};
+		unsigned long long xcr0{};
+
+		CpuInfo()
+		{
+			int registers[4]{};
+			__cpuid(registers, 0);
+			const int maxLeaf{ registers[0] };
+
+			if (maxLeaf >= 1)
+			{
+				__cpuid(registers, 1);
+				leaf1Ecx = registers[2];
+			}
+			if (maxLeaf >= 7)
+			{
+				__cpuidex(registers, 7, 0);
+				leaf7Ebx = registers[1];
+			}
+			//xgetbv faults when the OS hasn't enabled it
+			if (leaf1Ecx & LEAF1_ECX_OSXSAVE)
+			{
+				xcr0 = _xgetbv(0);
+			}
+		}
+
+		bool HasAll(int features, int registerValue) const { return (registerValue & features) == features; }
+		bool SavesState(unsigned long long state) const { return (xcr0 & state) == state; }
+	};
+
+	const CpuInfo& GetCpuInfo()
+	{
+		static const CpuInfo info{};
+		return info;
+	}
+}
+
+namespace dae
+{
+	namespace CpuFeatures
+	{
+		bool IsSupported(SimdLevel level)
+		{
+			const CpuInfo& info{ GetCpuInfo() };
+			switch (level)
+			{
+			case SimdLevel::SSE4:
+				return info.HasAll(LEAF1_ECX_SSE41, info.leaf1Ecx);
+			case SimdLevel::AVX2:
+				return info.HasAll(LEAF1_ECX_SSE41 | LEAF1_ECX_AVX, info.leaf1Ecx) && info.HasAll(LEAF7_EBX_AVX2, info.leaf7Ebx)
+					&& info.SavesState(XCR0_AVX_STATE);
+			case SimdLevel::AVX512:
+				return IsSupported(SimdLevel::AVX2) && info.HasAll(LEAF7_EBX_AVX512F | LEAF7_EBX_AVX512VL, info.leaf7Ebx)
+					&& info.SavesState(XCR0_AVX512_STATE);
+			default:
+				return false;
+			}
+		}
+
+		bool GetHighestSupportedLevel(SimdLevel& level)
+		{
+			for (const SimdLevel candidate : { SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE4 })
+			{
+				if (IsSupported(candidate))
+				{
+					level = candidate;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		const char* GetName(SimdLevel level)
+		{
+			switch (level)
+			{
+			case SimdLevel::AVX2:
+				return "avx2";
+			case SimdLevel::AVX512:
+				return "avx512";
+			default:
+				return "sse4";
+			}
+		}
+
+		bool ParseLevel(const std::string& name, SimdLevel& level)
+		{
+			std::string lowerCase{ name };
+			std::transform(lowerCase.begin(), lowerCase.end(), lowerCase.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+			for (const SimdLevel candidate : { SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::AVX512 })
+			{
+				if (lowerCase == GetName(candidate))
+				{
+					level = candidate;
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+}
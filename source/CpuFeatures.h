@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+
+//The SimdLevel values for the preprocessor, SIMD_KERNEL_LEVEL is one of these in the kernels (see SIMD.h)
+#define SIMD_LEVEL_SSE4 0
+#define SIMD_LEVEL_AVX2 1
+#define SIMD_LEVEL_AVX512 2
+
+namespace dae
+{
+	//Instruction sets the SIMD kernels are built for, oldest first. A CPU that has a level has every level before it
+	enum class SimdLevel
+	{
+		SSE4 = SIMD_LEVEL_SSE4,		//SSE4.1, every lane of a Float8 in two 128 bit registers
+		AVX2 = SIMD_LEVEL_AVX2,		//AVX2, one 256 bit register and hardware gathers
+		AVX512 = SIMD_LEVEL_AVX512	//AVX-512 F + VL, still 8 lanes but with the instructions AVX-512 adds for 256 bit registers
+	};
+
+	namespace CpuFeatures
+	{
+		//True when the CPU has the instructions of level and the OS saves its registers, from cpuid
+		bool IsSupported(SimdLevel level);
+		//The newest supported level in level. False when not even SSE4 is supported, the kernels aren't built for anything older
+		bool GetHighestSupportedLevel(SimdLevel& level);
+
+		//"sse4", "avx2" or "avx512"
+		const char* GetName(SimdLevel level);
+		//The level with that name, case insensitive. False when there is none
+		bool ParseLevel(const std::string& name, SimdLevel& level);
+	}
+}
@@ -20,6 +20,18 @@ struct Vertex_Out
 	Vector3 Normal{};
 	Vector3 Tangent{};
 	Vector3 ViewDirection{};
+	//How much Uv changes to the next pixel on the right and below, picks the mip level
+	Vector2 UvDdx{};
+	Vector2 UvDdy{};
+};
+
+//Per vertex attributes of a transformed vertex that only shading reads, kept apart from the positions
+struct Vertex_Varyings
+{
+	Vector2 Uv{};
+	Vector3 Normal{};
+	Vector3 Tangent{};
+	Vector3 ViewDirection{};
 };
 
 enum class PrimitiveTopology
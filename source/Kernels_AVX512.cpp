@@ -0,0 +1,6 @@
+#include "pch.h"
+//The SIMD kernels built for AVX-512 (F + VL), see SIMD.h
+#define SIMD_KERNEL_LEVEL SIMD_LEVEL_AVX512
+#include "Mesh_Kernels.inl"
+#include "Texture_Kernels.inl"
+#include "Rasterizer_Software_Kernels.inl"
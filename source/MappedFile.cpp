@@ -0,0 +1,33 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	m_File = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+		return;
+
+	m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping == nullptr)
+		return;
+
+	m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_pData != nullptr)
+	{
+		m_Size = static_cast<size_t>(size.QuadPart);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_pData != nullptr)
+		UnmapViewOfFile(m_pData);
+	if (m_Mapping != nullptr)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+}
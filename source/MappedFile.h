@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+
+//Read only view of a whole file, GetData() is nullptr when the file couldn't be opened or is empty
+class MappedFile final
+{
+public:
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&&) noexcept = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+	const uint8_t* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	HANDLE m_File{ INVALID_HANDLE_VALUE };
+	HANDLE m_Mapping{ nullptr };
+	const uint8_t* m_pData{ nullptr };
+	size_t m_Size{};
+};
@@ -4,6 +4,7 @@
 #include "Camera.h"
 #include "Texture.h"
 #include "Effect.h"
+#include "ThreadPool.h"
 
 using namespace dae;
 
@@ -12,11 +13,21 @@ Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& ind
 	m_Indices{ indices }
 {
 	m_WorldMatrix = Matrix::CreateTranslation(m_WorldMatrix.GetTranslation()+ Vector3{ 0.f, 0.f, 50.f });
-	m_Vertices_Out.reserve(m_Vertices.size());
+	m_PositionsOut.resize(m_Vertices.size());
+	m_VaryingsOut.resize(m_Vertices.size());
 
-	for (size_t i = 0; i < m_Vertices_Out.capacity(); i++)
+	SourceStreams& streams{ m_SourceStreams };
+	for (const Vertex& vertex : m_Vertices)
 	{
-		m_Vertices_Out.emplace_back(Vertex_Out{});
+		streams.positionX.push_back(vertex.Position.x);
+		streams.positionY.push_back(vertex.Position.y);
+		streams.positionZ.push_back(vertex.Position.z);
+		streams.normalX.push_back(vertex.Normal.x);
+		streams.normalY.push_back(vertex.Normal.y);
+		streams.normalZ.push_back(vertex.Normal.z);
+		streams.tangentX.push_back(vertex.Tangent.x);
+		streams.tangentY.push_back(vertex.Tangent.y);
+		streams.tangentZ.push_back(vertex.Tangent.z);
 	}
 
 }
@@ -177,35 +188,80 @@ void Mesh::CycleFilterMode()
 	m_pEffect->CycleFilterMode();
 	m_pTechniqueLocalPointer = m_pEffect->GetTechnique();
 }
-void Mesh::TransformVertices(Camera* pCamera,int w, int h)
+void Mesh::TransformVertices(Camera* pCamera,int w, int h, SimdLevel simdLevel, ThreadPool* pThreadPool, int chunkSize)
 {
 	const Matrix worldViewProjection{m_WorldMatrix * pCamera->invViewMatrix * pCamera->projectionMatrix };
-	for (size_t i = 0; i < m_Vertices.size(); i++)
+
+	//The kernel built for simdLevel
+	void (Mesh::*transformRange)(size_t, size_t, const Matrix&, const Vector3&, int, int){ nullptr };
+	switch (simdLevel)
 	{
-		m_Vertices_Out[i].Position.x = m_Vertices[i].Position.x;
-		m_Vertices_Out[i].Position.y = m_Vertices[i].Position.y;
-		m_Vertices_Out[i].Position.z = m_Vertices[i].Position.z;
-		m_Vertices_Out[i].Uv = m_Vertices[i].Uv;
-		m_Vertices_Out[i].Normal = m_WorldMatrix.TransformVector(m_Vertices[i].Normal).Normalized();
-		m_Vertices_Out[i].Tangent = m_WorldMatrix.TransformVector(m_Vertices[i].Tangent).Normalized();
-		m_Vertices_Out[i].ViewDirection = m_WorldMatrix.TransformPoint(m_Vertices[i].Position) - pCamera->origin;
+	case SimdLevel::AVX512:
+		transformRange = &Mesh::TransformRange<SimdLevel::AVX512>;
+		break;
+	case SimdLevel::AVX2:
+		transformRange = &Mesh::TransformRange<SimdLevel::AVX2>;
+		break;
+	default:
+		transformRange = &Mesh::TransformRange<SimdLevel::SSE4>;
+		break;
+	}
 
+	//Drop the vertices the clipper added last frame
+	m_PositionsOut.resize(m_Vertices.size());
+	m_VaryingsOut.resize(m_Vertices.size());
+	m_ClipPositions.resize(m_Vertices.size());
 
-		m_Vertices_Out[i].Position = worldViewProjection.TransformPoint(m_Vertices_Out[i].Position);
+	const size_t nrVertices{ m_Vertices.size() };
+	if (pThreadPool == nullptr || chunkSize <= 0)
+	{
+		(this->*transformRange)(0, nrVertices, worldViewProjection, pCamera->origin, w, h);
+		return;
+	}
 
+	//Chunks start at a multiple of 8 so only the last one has a scalar tail
+	const size_t chunk{ (static_cast<size_t>(chunkSize) + 7) / 8 * 8 };
+	const int nrChunks{ static_cast<int>((nrVertices + chunk - 1) / chunk) };
+	pThreadPool->ParallelFor(nrChunks, [&](int chunkIdx)
+		{
+			const size_t begin{ chunkIdx * chunk };
+			(this->*transformRange)(begin, std::min(begin + chunk, nrVertices), worldViewProjection, pCamera->origin, w, h);
+		});
+}
+void Mesh::TransformVertex(size_t idx, const Matrix& worldViewProjection, const Vector3& cameraOrigin, int w, int h)
+{
+	Vertex_Varyings& varyings{ m_VaryingsOut[idx] };
+	varyings.Uv = m_Vertices[idx].Uv;
+	varyings.Normal = m_WorldMatrix.TransformVector(m_Vertices[idx].Normal).Normalized();
+	varyings.Tangent = m_WorldMatrix.TransformVector(m_Vertices[idx].Tangent).Normalized();
+	varyings.ViewDirection = m_WorldMatrix.TransformPoint(m_Vertices[idx].Position) - cameraOrigin;
 
-		//Perspective Divide
-		const float invW{ 1.f / m_Vertices_Out[i].Position.w };
 
-		m_Vertices_Out[i].Position.x *= invW;
-		m_Vertices_Out[i].Position.y *= invW;
-		m_Vertices_Out[i].Position.z *= invW;
+	m_ClipPositions[idx] = worldViewProjection.TransformPoint(Vector4{ m_Vertices[idx].Position, 1.f });
+	m_PositionsOut[idx] = ClipToScreen(m_ClipPositions[idx], w, h);
+}
+uint32_t Mesh::AddVertexOut(const Vector4& position, const Vertex_Varyings& varyings)
+{
+	m_PositionsOut.push_back(position);
+	m_VaryingsOut.push_back(varyings);
+	return static_cast<uint32_t>(m_PositionsOut.size() - 1);
+}
+Vector4 Mesh::ClipToScreen(const Vector4& clipPosition, int w, int h)
+{
+	Vector4 position{ clipPosition };
 
+	//Perspective Divide
+	const float invW{ 1.f / position.w };
 
-		m_Vertices_Out[i].Position.x = (m_Vertices_Out[i].Position.x + 1) / 2 * w;
-		m_Vertices_Out[i].Position.y = (1 - m_Vertices_Out[i].Position.y) / 2 * h;
+	position.x *= invW;
+	position.y *= invW;
+	position.z *= invW;
 
-	}
+
+	position.x = (position.x + 1) / 2 * w;
+	position.y = (1 - position.y) / 2 * h;
+
+	return position;
 }
 void Mesh::RotateY(float angle, float deltaTime)
 {
@@ -1,9 +1,11 @@
 #pragma once
 #include "DataTypes.h"
 #include "Matrix.h"
+#include "CpuFeatures.h"
 
 struct Camera;
 class Effect;
+class ThreadPool;
 
 class Mesh final
 {
@@ -21,20 +23,45 @@ public:
 	void UpdateMatrices(const Camera& camera);
 
 	void CycleFilterMode();
-	void TransformVertices(Camera* pCamera,int w, int h);
+	//With a thread pool and a chunk size > 0 the vertices are split in chunks that are transformed in parallel.
+	//Every vertex is computed the same way no matter which chunk or thread handles it, or which SIMD level's kernel
+	void TransformVertices(Camera* pCamera,int w, int h, SimdLevel simdLevel, ThreadPool* pThreadPool = nullptr, int chunkSize = 0);
+	//Appends a vertex made by the clipper to the output streams, returns its index. Dropped again by the next TransformVertices
+	uint32_t AddVertexOut(const Vector4& position, const Vertex_Varyings& varyings);
+	//Perspective divide + viewport, w is kept so attributes can be interpolated perspective correct
+	static Vector4 ClipToScreen(const Vector4& clipPosition, int w, int h);
 	void RotateY(float angle, float deltaTime);
 
 	Matrix GetWorldMatrix()const { return m_WorldMatrix; }
-	const std::vector<Vertex_Out>& GetVerticesOut() const { return m_Vertices_Out; }
+	//Transformed vertices, split in streams: screen space positions (x, y, depth, w) and the varyings for shading
+	const std::vector<Vector4>& GetPositionsOut() const { return m_PositionsOut; }
+	const std::vector<Vertex_Varyings>& GetVaryingsOut() const { return m_VaryingsOut; }
+	const std::vector<Vector4>& GetClipPositions() const { return m_ClipPositions; }
 	const std::vector<uint32_t>& GetIndices()const { return m_Indices; }
 
 private:
 	std::vector<Vertex>		m_Vertices;
-	std::vector<Vertex_Out>	m_Vertices_Out;
+
+	//Source positions, normals and tangents as structure of arrays, so the transform loads 8 vertices per register
+	struct SourceStreams
+	{
+		std::vector<float> positionX, positionY, positionZ;
+		std::vector<float> normalX, normalY, normalZ;
+		std::vector<float> tangentX, tangentY, tangentZ;
+	};
+	SourceStreams			m_SourceStreams;
+	std::vector<Vector4>	m_PositionsOut;
+	std::vector<Vertex_Varyings>	m_VaryingsOut;
+	std::vector<Vector4>	m_ClipPositions;
 	std::vector<uint32_t>	m_Indices;
 
 	Matrix					m_WorldMatrix;
 
+	//Built once per SIMD level with the kernels (Mesh_Kernels.inl)
+	template<SimdLevel LEVEL>
+	void TransformRange(size_t begin, size_t end, const Matrix& worldViewProjection, const Vector3& cameraOrigin, int w, int h);
+	void TransformVertex(size_t idx, const Matrix& worldViewProjection, const Vector3& cameraOrigin, int w, int h);
+
 	Effect* m_pEffect{nullptr};
 
 	ID3DX11Effect* m_pEffectLocalPointer{nullptr};
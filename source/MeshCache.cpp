@@ -0,0 +1,186 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+
+namespace
+{
+	using namespace dae;
+
+	//Bump whenever the processing that produces the cached arrays changes (parsing, welding, an optimizer pass), old caches are then rebuilt.
+	//Changes to MeshCache::Settings don't need it, they are stored in every header
+	constexpr uint32_t MESH_CACHE_VERSION{ 3 };
+	constexpr char MESH_CACHE_MAGIC[4]{ 'M', 'S', 'H', 'C' };
+
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t nrVertices;
+		uint32_t nrIndices;
+
+		//The MeshCache::Settings the arrays were processed with
+		uint32_t processingFlags;
+		float overdrawThreshold;
+		uint32_t padding;
+
+		//The source file the cache was made from
+		uint64_t sourceSize;
+		int64_t sourceWriteTime;
+		uint64_t sourceHash;
+
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	constexpr uint32_t FLIP_AXIS_AND_WINDING_FLAG{ 1 << 0 };
+	constexpr uint32_t WELD_VERTICES_FLAG{ 1 << 1 };
+
+	uint32_t GetProcessingFlags(const MeshCache::Settings& settings)
+	{
+		return (settings.flipAxisAndWinding ? FLIP_AXIS_AND_WINDING_FLAG : 0) | (settings.weldVertices ? WELD_VERTICES_FLAG : 0);
+	}
+
+	std::string GetCacheFilename(const std::string& sourceFilename)
+	{
+		return sourceFilename + ".meshcache";
+	}
+
+	//FNV-1a over the whole source file, 0 when it can't be read
+	uint64_t HashFile(const std::string& filename)
+	{
+		const MappedFile file{ filename };
+		if (file.GetData() == nullptr)
+			return 0;
+
+		uint64_t hash{ 14695981039346656037ull };
+		for (size_t i = 0; i < file.GetSize(); ++i)
+		{
+			hash = (hash ^ file.GetData()[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	int64_t GetWriteTime(const std::string& filename)
+	{
+		std::error_code error{};
+		const auto writeTime{ std::filesystem::last_write_time(filename, error) };
+		return error ? 0 : static_cast<int64_t>(writeTime.time_since_epoch().count());
+	}
+
+	//Overwrites only that field of the cache's header, the cache stays valid when it fails
+	void UpdateSourceWriteTime(const std::string& cacheFilename, int64_t sourceWriteTime)
+	{
+		std::fstream file{ cacheFilename, std::ios::binary | std::ios::in | std::ios::out };
+		if (!file)
+			return;
+
+		file.seekp(offsetof(MeshCacheHeader, sourceWriteTime));
+		file.write(reinterpret_cast<const char*>(&sourceWriteTime), sizeof(sourceWriteTime));
+	}
+}
+
+namespace dae
+{
+	namespace MeshCache
+	{
+		bool Load(const std::string& sourceFilename, const Settings& settings, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, Vector3& boundsMin, Vector3& boundsMax)
+		{
+			const std::string cacheFilename{ GetCacheFilename(sourceFilename) };
+			MeshCacheHeader header{};
+			int64_t sourceWriteTime{};
+			{
+				const MappedFile file{ cacheFilename };
+				if (file.GetSize() < sizeof(MeshCacheHeader))
+					return false;
+
+				memcpy(&header, file.GetData(), sizeof(MeshCacheHeader));
+
+				const size_t verticesSize{ size_t(header.nrVertices) * sizeof(Vertex) };
+				const size_t indicesSize{ size_t(header.nrIndices) * sizeof(uint32_t) };
+				if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 || header.version != MESH_CACHE_VERSION
+					|| header.vertexSize != sizeof(Vertex) || file.GetSize() != sizeof(MeshCacheHeader) + verticesSize + indicesSize)
+					return false;
+				if (header.processingFlags != GetProcessingFlags(settings) || header.overdrawThreshold != settings.overdrawThreshold)
+					return false;
+
+				//Touching the source without changing it (a checkout, a copy) only costs a hash
+				std::error_code error{};
+				const uint64_t sourceSize{ std::filesystem::file_size(sourceFilename, error) };
+				if (error || sourceSize != header.sourceSize)
+					return false;
+				sourceWriteTime = GetWriteTime(sourceFilename);
+				if (sourceWriteTime != header.sourceWriteTime && HashFile(sourceFilename) != header.sourceHash)
+					return false;
+
+				const uint8_t* pVertices{ file.GetData() + sizeof(MeshCacheHeader) };
+				vertices.resize(header.nrVertices);
+				memcpy(vertices.data(), pVertices, verticesSize);
+				indices.resize(header.nrIndices);
+				memcpy(indices.data(), pVertices + verticesSize, indicesSize);
+
+				//A cache of the right size can still be damaged or edited, an index past the vertices would be read out of bounds later
+				if (header.nrIndices == 0 || header.nrIndices % 3 != 0
+					|| std::any_of(indices.begin(), indices.end(), [&](uint32_t index) { return index >= header.nrVertices; }))
+				{
+					vertices.clear();
+					indices.clear();
+					return false;
+				}
+			}
+
+			//The source was only touched: store its new write time so the next launch doesn't hash it again. The file is unmapped by now
+			if (sourceWriteTime != header.sourceWriteTime)
+			{
+				UpdateSourceWriteTime(cacheFilename, sourceWriteTime);
+			}
+
+			boundsMin = Vector3{ header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] };
+			boundsMax = Vector3{ header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] };
+			return true;
+		}
+
+		bool Save(const std::string& sourceFilename, const Settings& settings, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+		{
+			MeshCacheHeader header{};
+			memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+			header.version = MESH_CACHE_VERSION;
+			header.vertexSize = sizeof(Vertex);
+			header.nrVertices = static_cast<uint32_t>(vertices.size());
+			header.nrIndices = static_cast<uint32_t>(indices.size());
+			header.processingFlags = GetProcessingFlags(settings);
+			header.overdrawThreshold = settings.overdrawThreshold;
+
+			std::error_code error{};
+			header.sourceSize = std::filesystem::file_size(sourceFilename, error);
+			if (error)
+				return false;
+			header.sourceWriteTime = GetWriteTime(sourceFilename);
+			header.sourceHash = HashFile(sourceFilename);
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				header.boundsMin[axis] = vertices.empty() ? 0.f : FLT_MAX;
+				header.boundsMax[axis] = vertices.empty() ? 0.f : -FLT_MAX;
+				for (const Vertex& vertex : vertices)
+				{
+					header.boundsMin[axis] = std::min(header.boundsMin[axis], vertex.Position[axis]);
+					header.boundsMax[axis] = std::max(header.boundsMax[axis], vertex.Position[axis]);
+				}
+			}
+
+			std::ofstream file{ GetCacheFilename(sourceFilename), std::ios::binary | std::ios::trunc };
+			if (!file)
+				return false;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+			file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+			file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+			return file.good();
+		}
+	}
+}
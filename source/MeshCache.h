@@ -0,0 +1,24 @@
+#pragma once
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Binary copy of a fully processed (welded, reordered) mesh, written next to its source file as <source>.meshcache.
+	//Later launches map it and copy the arrays out instead of parsing the source again
+	namespace MeshCache
+	{
+		//How the source was turned into the cached arrays, a cache made with other settings is rebuilt.
+		//The algorithms themselves aren't in here: bump MESH_CACHE_VERSION (MeshCache.cpp) whenever the parser, the welding or an optimizer pass changes
+		struct Settings
+		{
+			bool flipAxisAndWinding;
+			bool weldVertices;
+			//Of MeshOptimizer::OptimizeOverdraw
+			float overdrawThreshold;
+		};
+
+		//False when there is no cache, it was written by another version or with other settings, the source file changed since or its indices are out of range
+		bool Load(const std::string& sourceFilename, const Settings& settings, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, Vector3& boundsMin, Vector3& boundsMax);
+		bool Save(const std::string& sourceFilename, const Settings& settings, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	}
+}
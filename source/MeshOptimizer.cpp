@@ -0,0 +1,427 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+namespace
+{
+	using namespace dae;
+
+	//Size of the LRU cache Forsyth's scores are tuned for
+	constexpr int FORSYTH_CACHE_SIZE{ 32 };
+	//FIFO cache used to cut the triangle list in clusters, matches AnalyzeVertexCache's default
+	constexpr int CLUSTER_CACHE_SIZE{ 16 };
+	constexpr int OVERDRAW_GRID_SIZE{ 256 };
+
+	float ForsythVertexScore(int cachePosition, uint32_t nrRemainingTriangles)
+	{
+		//Vertices without triangles left can be forgotten
+		if (nrRemainingTriangles == 0)
+			return -1.f;
+
+		float score{};
+		if (cachePosition >= 0)
+		{
+			//The last triangle's vertices get a fixed score so the next triangle doesn't just reuse the same edge
+			if (cachePosition < 3)
+			{
+				score = 0.75f;
+			}
+			else
+			{
+				const float scale{ 1.f / (FORSYTH_CACHE_SIZE - 3) };
+				score = powf(1.f - (cachePosition - 3) * scale, 1.5f);
+			}
+		}
+
+		//Finishing vertices with few triangles left gets rid of them before they are evicted
+		score += 2.f / sqrtf(static_cast<float>(nrRemainingTriangles));
+		return score;
+	}
+
+	//Geometric normal, scaled by twice the triangle's area
+	Vector3 TriangleNormal(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t triangleIdx)
+	{
+		const Vector3& p0{ vertices[indices[triangleIdx * 3]].Position };
+		const Vector3& p1{ vertices[indices[triangleIdx * 3 + 1]].Position };
+		const Vector3& p2{ vertices[indices[triangleIdx * 3 + 2]].Position };
+		return Vector3::Cross(p1 - p0, p2 - p0);
+	}
+
+	//1 when the geometric normals of front faces agree with the vertex normals, -1 when the winding is the other way around
+	float GetFrontFaceSign(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		float agreement{};
+		for (size_t triangleIdx = 0; triangleIdx < indices.size() / 3; ++triangleIdx)
+		{
+			const Vector3 vertexNormals{ vertices[indices[triangleIdx * 3]].Normal + vertices[indices[triangleIdx * 3 + 1]].Normal + vertices[indices[triangleIdx * 3 + 2]].Normal };
+			agreement += Vector3::Dot(TriangleNormal(vertices, indices, triangleIdx), vertexNormals) > 0.f ? 1.f : -1.f;
+		}
+		return agreement >= 0.f ? 1.f : -1.f;
+	}
+}
+
+namespace dae
+{
+	namespace MeshOptimizer
+	{
+		float AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t nrVertices, int cacheSize)
+		{
+			if (indices.empty())
+				return 0.f;
+
+			//A vertex is in the FIFO as long as fewer than cacheSize misses happened since it was loaded
+			std::vector<uint32_t> loadTimes(nrVertices, 0);
+			uint32_t nrMisses{ static_cast<uint32_t>(cacheSize) + 1 };
+			const uint32_t firstMiss{ nrMisses };
+
+			for (uint32_t index : indices)
+			{
+				if (nrMisses - loadTimes[index] > static_cast<uint32_t>(cacheSize))
+				{
+					loadTimes[index] = nrMisses++;
+				}
+			}
+
+			return static_cast<float>(nrMisses - firstMiss) / (indices.size() / 3);
+		}
+
+		float AnalyzeOverdraw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+		{
+			if (vertices.empty() || indices.empty())
+				return 0.f;
+
+			Vector3 boundsMin{ vertices[0].Position };
+			Vector3 boundsMax{ vertices[0].Position };
+			for (const Vertex& vertex : vertices)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					boundsMin[axis] = std::min(boundsMin[axis], vertex.Position[axis]);
+					boundsMax[axis] = std::max(boundsMax[axis], vertex.Position[axis]);
+				}
+			}
+			const Vector3 extent{ boundsMax - boundsMin };
+			const float scale{ (OVERDRAW_GRID_SIZE - 1) / std::max(std::max(extent.x, extent.y), std::max(extent.z, FLT_MIN)) };
+
+			const float frontFaceSign{ GetFrontFaceSign(vertices, indices) };
+			std::vector<float> depthBuffer(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE);
+			uint64_t nrShaded{};
+			uint64_t nrCovered{};
+
+			//Orthographic views looking down each axis from both sides
+			for (int view = 0; view < 6; ++view)
+			{
+				const int axis{ view / 2 };
+				const int axisU{ (axis + 1) % 3 };
+				const int axisV{ (axis + 2) % 3 };
+				const float viewSign{ view % 2 == 0 ? 1.f : -1.f };
+
+				std::fill(depthBuffer.begin(), depthBuffer.end(), FLT_MAX);
+
+				for (size_t triangleIdx = 0; triangleIdx < indices.size() / 3; ++triangleIdx)
+				{
+					//Cull faces that point away from the viewer
+					if (TriangleNormal(vertices, indices, triangleIdx)[axis] * frontFaceSign * viewSign <= 0.f)
+						continue;
+
+					float x[3], y[3], depth[3];
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						const Vector3& position{ vertices[indices[triangleIdx * 3 + corner]].Position };
+						x[corner] = (position[axisU] - boundsMin[axisU]) * scale;
+						y[corner] = (position[axisV] - boundsMin[axisV]) * scale;
+						depth[corner] = -viewSign * position[axis];
+					}
+
+					const float area{ (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]) };
+					if (area == 0.f)
+						continue;
+
+					const int minX{ std::max(0, static_cast<int>(std::min({ x[0], x[1], x[2] }))) };
+					const int maxX{ std::min(OVERDRAW_GRID_SIZE - 1, static_cast<int>(std::max({ x[0], x[1], x[2] }))) };
+					const int minY{ std::max(0, static_cast<int>(std::min({ y[0], y[1], y[2] }))) };
+					const int maxY{ std::min(OVERDRAW_GRID_SIZE - 1, static_cast<int>(std::max({ y[0], y[1], y[2] }))) };
+
+					for (int py = minY; py <= maxY; ++py)
+					{
+						for (int px = minX; px <= maxX; ++px)
+						{
+							const float sampleX{ px + .5f };
+							const float sampleY{ py + .5f };
+
+							//Weights are positive inside for either winding since they are divided by the signed area
+							const float w0{ ((x[1] - sampleX) * (y[2] - sampleY) - (y[1] - sampleY) * (x[2] - sampleX)) / area };
+							const float w1{ ((x[2] - sampleX) * (y[0] - sampleY) - (y[2] - sampleY) * (x[0] - sampleX)) / area };
+							const float w2{ 1.f - w0 - w1 };
+							if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+								continue;
+
+							const float sampleDepth{ w0 * depth[0] + w1 * depth[1] + w2 * depth[2] };
+							float& storedDepth{ depthBuffer[py * OVERDRAW_GRID_SIZE + px] };
+							if (sampleDepth < storedDepth)
+							{
+								storedDepth = sampleDepth;
+								++nrShaded;
+							}
+						}
+					}
+				}
+
+				nrCovered += std::count_if(depthBuffer.begin(), depthBuffer.end(), [](float depth) { return depth != FLT_MAX; });
+			}
+
+			return nrCovered == 0 ? 0.f : static_cast<float>(nrShaded) / nrCovered;
+		}
+
+		void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t nrVertices)
+		{
+			const size_t nrTriangles{ indices.size() / 3 };
+			if (nrTriangles == 0)
+				return;
+
+			//Triangles of every vertex, packed: vertex v owns adjacency[adjacencyOffsets[v]] until adjacencyOffsets[v + 1]
+			std::vector<uint32_t> nrRemainingTriangles(nrVertices, 0);
+			for (uint32_t index : indices)
+			{
+				++nrRemainingTriangles[index];
+			}
+
+			std::vector<uint32_t> adjacencyOffsets(nrVertices + 1, 0);
+			for (size_t v = 0; v < nrVertices; ++v)
+			{
+				adjacencyOffsets[v + 1] = adjacencyOffsets[v] + nrRemainingTriangles[v];
+			}
+
+			std::vector<uint32_t> adjacency(indices.size());
+			std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				adjacency[adjacencyFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			std::vector<int> cachePositions(nrVertices, -1);
+			std::vector<float> vertexScores(nrVertices);
+			for (size_t v = 0; v < nrVertices; ++v)
+			{
+				vertexScores[v] = ForsythVertexScore(-1, nrRemainingTriangles[v]);
+			}
+
+			std::vector<float> triangleScores(nrTriangles);
+			std::vector<bool> isEmitted(nrTriangles, false);
+			int bestTriangle{ 0 };
+			for (size_t t = 0; t < nrTriangles; ++t)
+			{
+				triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				if (triangleScores[t] > triangleScores[bestTriangle])
+				{
+					bestTriangle = static_cast<int>(t);
+				}
+			}
+
+			std::vector<uint32_t> cache;
+			std::vector<uint32_t> newCache;
+			cache.reserve(FORSYTH_CACHE_SIZE + 3);
+			newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+			std::vector<uint32_t> optimizedIndices;
+			optimizedIndices.reserve(indices.size());
+			size_t deadEndCursor{ 0 };
+
+			for (size_t nrEmitted = 0; nrEmitted < nrTriangles; ++nrEmitted)
+			{
+				//Nothing in the cache has triangles left, continue with the first triangle that wasn't drawn yet
+				if (bestTriangle < 0)
+				{
+					while (isEmitted[deadEndCursor])
+					{
+						++deadEndCursor;
+					}
+					bestTriangle = static_cast<int>(deadEndCursor);
+				}
+
+				const uint32_t* pTriangle{ &indices[bestTriangle * 3] };
+				optimizedIndices.insert(optimizedIndices.end(), pTriangle, pTriangle + 3);
+				isEmitted[bestTriangle] = true;
+
+				//The triangle's vertices move to the front of the LRU cache
+				newCache.assign(pTriangle, pTriangle + 3);
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					--nrRemainingTriangles[pTriangle[corner]];
+				}
+				for (uint32_t v : cache)
+				{
+					if (v != pTriangle[0] && v != pTriangle[1] && v != pTriangle[2])
+					{
+						newCache.push_back(v);
+					}
+				}
+
+				//Scores change for every vertex that is (or just was) in the cache, and with them the scores of their triangles
+				for (size_t i = 0; i < newCache.size(); ++i)
+				{
+					const uint32_t v{ newCache[i] };
+					cachePositions[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+					vertexScores[v] = ForsythVertexScore(cachePositions[v], nrRemainingTriangles[v]);
+				}
+
+				bestTriangle = -1;
+				float bestScore{ -FLT_MAX };
+				for (uint32_t v : newCache)
+				{
+					for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+					{
+						const uint32_t t{ adjacency[a] };
+						if (isEmitted[t])
+							continue;
+
+						triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+						if (triangleScores[t] > bestScore)
+						{
+							bestScore = triangleScores[t];
+							bestTriangle = static_cast<int>(t);
+						}
+					}
+				}
+
+				if (newCache.size() > FORSYTH_CACHE_SIZE)
+				{
+					newCache.resize(FORSYTH_CACHE_SIZE);
+				}
+				std::swap(cache, newCache);
+			}
+
+			indices = std::move(optimizedIndices);
+		}
+
+		void OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float threshold)
+		{
+			const size_t nrTriangles{ indices.size() / 3 };
+			if (nrTriangles == 0)
+				return;
+
+			//Same FIFO as AnalyzeVertexCache, moving nrMisses ahead by more than the cache size empties it
+			std::vector<uint32_t> loadTimes(vertices.size(), 0);
+			uint32_t nrMisses{ CLUSTER_CACHE_SIZE + 1 };
+			auto drawTriangle = [&](size_t triangleIdx)
+				{
+					uint32_t nrTriangleMisses{};
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						const uint32_t index{ indices[triangleIdx * 3 + corner] };
+						if (nrMisses - loadTimes[index] > CLUSTER_CACHE_SIZE)
+						{
+							loadTimes[index] = nrMisses++;
+							++nrTriangleMisses;
+						}
+					}
+					return nrTriangleMisses;
+				};
+			auto flushCache = [&]() { nrMisses += CLUSTER_CACHE_SIZE + 1; };
+
+			//Hard boundaries: triangles that miss on all 3 vertices start over with a cold cache anyway, reordering there costs nothing
+			std::vector<size_t> hardClusters;
+			for (size_t t = 0; t < nrTriangles; ++t)
+			{
+				if (drawTriangle(t) == 3)
+				{
+					hardClusters.push_back(t);
+				}
+			}
+			if (hardClusters.empty() || hardClusters[0] != 0)
+			{
+				hardClusters.insert(hardClusters.begin(), 0);
+			}
+			hardClusters.push_back(nrTriangles);
+
+			//Soft boundaries: cut a hard cluster as soon as its first part has paid off its cold start
+			std::vector<size_t> clusters;
+			for (size_t c = 0; c + 1 < hardClusters.size(); ++c)
+			{
+				const size_t begin{ hardClusters[c] };
+				const size_t end{ hardClusters[c + 1] };
+
+				flushCache();
+				uint32_t nrClusterMisses{};
+				for (size_t t = begin; t < end; ++t)
+				{
+					nrClusterMisses += drawTriangle(t);
+				}
+				const float clusterThreshold{ threshold * nrClusterMisses / (end - begin) };
+
+				flushCache();
+				clusters.push_back(begin);
+				size_t softBegin{ begin };
+				uint32_t nrSoftMisses{};
+				for (size_t t = begin; t < end; ++t)
+				{
+					nrSoftMisses += drawTriangle(t);
+					if (t + 1 < end && static_cast<float>(nrSoftMisses) / (t + 1 - softBegin) <= clusterThreshold)
+					{
+						clusters.push_back(t + 1);
+						softBegin = t + 1;
+						nrSoftMisses = 0;
+						flushCache();
+					}
+				}
+			}
+			clusters.push_back(nrTriangles);
+
+			//Clusters facing away from the center are on the outside of the mesh, they are drawn first so they hide the inside
+			const float frontFaceSign{ GetFrontFaceSign(vertices, indices) };
+			const size_t nrClusters{ clusters.size() - 1 };
+			std::vector<Vector3> clusterCentroids(nrClusters);
+			std::vector<Vector3> clusterNormals(nrClusters);
+			Vector3 meshCentroid{};
+			float meshArea{};
+
+			for (size_t c = 0; c < nrClusters; ++c)
+			{
+				Vector3 centroid{};
+				Vector3 normal{};
+				float area{};
+				for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+				{
+					const Vector3 triangleNormal{ TriangleNormal(vertices, indices, t) };
+					const float triangleArea{ triangleNormal.Magnitude() };
+					const Vector3 triangleCenter{ (vertices[indices[t * 3]].Position + vertices[indices[t * 3 + 1]].Position + vertices[indices[t * 3 + 2]].Position) / 3.f };
+
+					centroid += triangleCenter * triangleArea;
+					normal += triangleNormal * frontFaceSign;
+					area += triangleArea;
+				}
+
+				meshCentroid += centroid;
+				meshArea += area;
+				clusterCentroids[c] = area > 0.f ? centroid / area : centroid;
+				clusterNormals[c] = normal;
+			}
+			if (meshArea > 0.f)
+			{
+				meshCentroid /= meshArea;
+			}
+
+			std::vector<float> sortKeys(nrClusters);
+			for (size_t c = 0; c < nrClusters; ++c)
+			{
+				const float normalLength{ clusterNormals[c].Magnitude() };
+				sortKeys[c] = normalLength > 0.f ? Vector3::Dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]) / normalLength : 0.f;
+			}
+
+			std::vector<size_t> clusterOrder(nrClusters);
+			for (size_t c = 0; c < nrClusters; ++c)
+			{
+				clusterOrder[c] = c;
+			}
+			std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			std::vector<uint32_t> sortedIndices;
+			sortedIndices.reserve(indices.size());
+			for (size_t c : clusterOrder)
+			{
+				sortedIndices.insert(sortedIndices.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+			}
+
+			indices = std::move(sortedIndices);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Load time passes that reorder a triangle list index buffer, the vertices themselves are left untouched
+	namespace MeshOptimizer
+	{
+		//Average cache miss ratio: transformed vertices per triangle with a FIFO post-transform cache of cacheSize entries
+		float AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t nrVertices, int cacheSize = 16);
+		//Shaded pixels per covered pixel, averaged over 6 axis aligned views with depth testing and back face culling
+		float AnalyzeOverdraw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+		//Forsyth's linear speed vertex cache optimization: triangles that use recently used vertices are emitted first
+		void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t nrVertices);
+		//Splits the (cache optimized) list in clusters and draws the clusters that face away from the mesh center first, so they occlude the rest.
+		//A cluster may only cost threshold times its own cache miss ratio, 1.05 keeps nearly all of the cache optimization
+		void OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float threshold = 1.05f);
+	}
+}
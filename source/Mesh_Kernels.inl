@@ -0,0 +1,104 @@
+#pragma once
+//Mesh::TransformRange, compiled once per SIMD level by the Kernels_*.cpp files
+#include "Mesh.h"
+#include "SIMD.h"
+
+using namespace dae;
+
+template<SimdLevel LEVEL>
+void Mesh::TransformRange(size_t begin, size_t end, const Matrix& worldViewProjection, const Vector3& cameraOrigin, int w, int h)
+{
+	static_assert(LEVEL == SIMD_TARGET, "Instantiated once per level, by the kernels of that level");
+
+	//8 vertices per iteration: transform, divide, viewport and normal/tangent transform in one pass over the source streams.
+	//Every lane does the same operations in the same order as TransformVertex, so batched and single vertices give identical results
+	Float8 wvp[4][4]{};
+	Float8 world[4][3]{};
+	for (int r{ 0 }; r < 4; ++r)
+	{
+		for (int c{ 0 }; c < 4; ++c)
+		{
+			wvp[r][c] = Float8{ worldViewProjection[r][c] };
+		}
+		for (int c{ 0 }; c < 3; ++c)
+		{
+			world[r][c] = Float8{ m_WorldMatrix[r][c] };
+		}
+	}
+	const Float8 originX{ cameraOrigin.x };
+	const Float8 originY{ cameraOrigin.y };
+	const Float8 originZ{ cameraOrigin.z };
+	const Float8 one{ 1.f };
+	const Float8 two{ 2.f };
+	const Float8 width{ static_cast<float>(w) };
+	const Float8 height{ static_cast<float>(h) };
+
+	//Lanes are written back to the interleaved output streams through these
+	alignas(32) float clip[4][8];
+	alignas(32) float screen[3][8];
+	alignas(32) float normal[3][8];
+	alignas(32) float tangent[3][8];
+	alignas(32) float viewDirection[3][8];
+
+	const SourceStreams& streams{ m_SourceStreams };
+	size_t i{ begin };
+	for (; i + 8 <= end; i += 8)
+	{
+		const Float8 x{ Float8::Load(&streams.positionX[i]) };
+		const Float8 y{ Float8::Load(&streams.positionY[i]) };
+		const Float8 z{ Float8::Load(&streams.positionZ[i]) };
+
+		Float8 clipPosition[4];
+		for (int c{ 0 }; c < 4; ++c)
+		{
+			clipPosition[c] = wvp[0][c] * x + wvp[1][c] * y + wvp[2][c] * z + wvp[3][c];
+			clipPosition[c].Store(clip[c]);
+		}
+
+		//Perspective Divide + viewport
+		const Float8 invW{ one / clipPosition[3] };
+		((clipPosition[0] * invW + one) / two * width).Store(screen[0]);
+		((one - clipPosition[1] * invW) / two * height).Store(screen[1]);
+		(clipPosition[2] * invW).Store(screen[2]);
+
+		const auto transformNormalized = [&](const std::vector<float>& sourceX, const std::vector<float>& sourceY, const std::vector<float>& sourceZ, float (&out)[3][8])
+			{
+				const Float8 vx{ Float8::Load(&sourceX[i]) };
+				const Float8 vy{ Float8::Load(&sourceY[i]) };
+				const Float8 vz{ Float8::Load(&sourceZ[i]) };
+				const Float8 tx{ world[0][0] * vx + world[1][0] * vy + world[2][0] * vz };
+				const Float8 ty{ world[0][1] * vx + world[1][1] * vy + world[2][1] * vz };
+				const Float8 tz{ world[0][2] * vx + world[1][2] * vy + world[2][2] * vz };
+				const Float8 magnitude{ Float8::Sqrt(tx * tx + ty * ty + tz * tz) };
+				(tx / magnitude).Store(out[0]);
+				(ty / magnitude).Store(out[1]);
+				(tz / magnitude).Store(out[2]);
+			};
+		transformNormalized(streams.normalX, streams.normalY, streams.normalZ, normal);
+		transformNormalized(streams.tangentX, streams.tangentY, streams.tangentZ, tangent);
+
+		(world[0][0] * x + world[1][0] * y + world[2][0] * z + world[3][0] - originX).Store(viewDirection[0]);
+		(world[0][1] * x + world[1][1] * y + world[2][1] * z + world[3][1] - originY).Store(viewDirection[1]);
+		(world[0][2] * x + world[1][2] * y + world[2][2] * z + world[3][2] - originZ).Store(viewDirection[2]);
+
+		for (int lane{ 0 }; lane < 8; ++lane)
+		{
+			m_ClipPositions[i + lane] = Vector4{ clip[0][lane], clip[1][lane], clip[2][lane], clip[3][lane] };
+			m_PositionsOut[i + lane] = Vector4{ screen[0][lane], screen[1][lane], screen[2][lane], clip[3][lane] };
+
+			Vertex_Varyings& varyings{ m_VaryingsOut[i + lane] };
+			varyings.Uv = m_Vertices[i + lane].Uv;
+			varyings.Normal = Vector3{ normal[0][lane], normal[1][lane], normal[2][lane] };
+			varyings.Tangent = Vector3{ tangent[0][lane], tangent[1][lane], tangent[2][lane] };
+			varyings.ViewDirection = Vector3{ viewDirection[0][lane], viewDirection[1][lane], viewDirection[2][lane] };
+		}
+	}
+
+	for (; i < end; ++i)
+	{
+		TransformVertex(i, worldViewProjection, cameraOrigin, w, h);
+	}
+}
+
+//The only instantiation in this translation unit, the one for its level
+template void Mesh::TransformRange<SIMD_TARGET>(size_t begin, size_t end, const Matrix& worldViewProjection, const Vector3& cameraOrigin, int w, int h);
@@ -4,15 +4,91 @@
 #include "Texture.h"
 #include "Camera.h"
 #include "Utils.h"
+#include "ThreadPool.h"
 
 using namespace dae;
 
-Rasterizer_Software::Rasterizer_Software(SDL_Window* pWindow, int w, int h, Camera* pCamera) :
+namespace
+{
+	//Set associative cache with LRU replacement, sized like a typical L1 data cache (32 KB, 8 ways, 64 byte lines).
+	//Fed the texel addresses as samples read them, hardware counters aren't portable enough to read from here
+	class CacheModel final
+	{
+	public:
+		CacheModel()
+		{
+			//No address maps to the last line, so the cache starts out empty
+			for (uintptr_t* pWays : m_Lines)
+			{
+				std::fill_n(pWays, NR_WAYS, UINTPTR_MAX);
+			}
+		}
+
+		void Access(uintptr_t address)
+		{
+			++m_NrAccesses;
+			const uintptr_t line{ address / LINE_SIZE };
+			uintptr_t* pWays{ m_Lines[line % NR_SETS] };
+
+			//Ways are kept most recently used first
+			int way{ 0 };
+			while (way < NR_WAYS - 1 && pWays[way] != line)
+			{
+				++way;
+			}
+			if (pWays[way] != line)
+			{
+				++m_NrMisses;
+			}
+			for (; way > 0; --way)
+			{
+				pWays[way] = pWays[way - 1];
+			}
+			pWays[0] = line;
+		}
+
+		uint64_t GetNrAccesses() const { return m_NrAccesses; }
+		uint64_t GetNrMisses() const { return m_NrMisses; }
+
+	private:
+		static constexpr int LINE_SIZE{ 64 };
+		static constexpr int NR_WAYS{ 8 };
+		static constexpr int NR_SETS{ 32 * 1024 / (LINE_SIZE * NR_WAYS) };
+
+		uintptr_t m_Lines[NR_SETS][NR_WAYS]{};
+		uint64_t m_NrAccesses{};
+		uint64_t m_NrMisses{};
+	};
+
+	//RGBA8 texels, r in the lowest byte
+	uint32_t PackSpecularGloss(uint32_t specular, uint32_t gloss)
+	{
+		return (specular & 0x00FFFFFF) | ((gloss & 0xFF) << 24);
+	}
+
+	uint32_t DecodeNormal(uint32_t normal)
+	{
+		//Normalized once here, z is rebuilt from x and y when shading. The map only points away from the surface
+		Vector3 decoded{ (normal & 0xFF) / 127.5f - 1.f, ((normal >> 8) & 0xFF) / 127.5f - 1.f, ((normal >> 16) & 0xFF) / 127.5f - 1.f };
+		decoded = decoded.SqrMagnitude() > 0.f ? decoded.Normalized() : Vector3::UnitZ;
+		const auto encode = [](float component) { return static_cast<uint32_t>(std::lround((component * .5f + .5f) * 255.f)); };
+		return encode(decoded.x) | (encode(decoded.y) << 8) | 0xFF000000;
+	}
+}
+
+Rasterizer_Software::Rasterizer_Software(SDL_Window* pWindow, int w, int h, Camera* pCamera, SimdLevel simdLevel) :
 	m_pWindow{pWindow},
 	m_Width{ w },
 	m_Height{ h },
-	m_pCamera{pCamera}
+	m_pCamera{pCamera},
+	m_SimdLevel{ simdLevel }
 {
+	//main doesn't get this far when the CPU supports none of the levels, but the log shouldn't claim support it didn't detect
+	SimdLevel highestLevel{};
+	const bool isSupported{ CpuFeatures::GetHighestSupportedLevel(highestLevel) };
+	std::cout << "**(SOFTWARE) SIMD kernels: " << CpuFeatures::GetName(m_SimdLevel) << " for rasterization + shading, vertex transform and texture sampling (CPU supports "
+		<< (isSupported ? std::string{ "up to " } + CpuFeatures::GetName(highestLevel) : std::string{ "none of them" }) << ")\n";
+
 	//Create Buffers
 	m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
 	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
@@ -21,21 +97,55 @@ Rasterizer_Software::Rasterizer_Software(SDL_Window* pWindow, int w, int h, Came
 	//Initialize depthBuffer
 	m_pDepthBufferPixels = new float[m_Width * m_Height] {INFINITY};
 
-	//Load in textures
-	m_pVehicleDiffuse = Texture::LoadFromFile("Resources/vehicle_diffuse.png");
-	m_pVehicleNormal = Texture::LoadFromFile("Resources/vehicle_normal.png");
-	m_pVehicleGloss = Texture::LoadFromFile("Resources/vehicle_gloss.png");
-	m_pVehicleSpecular = Texture::LoadFromFile("Resources/vehicle_specular.png");
+	//Visibility buffer, only filled in when shading is deferred
+	m_pTriangleIdBuffer = new uint32_t[m_Width * m_Height]{};
+	m_pWeightBuffer = new Vector3[m_Width * m_Height]{};
 
+	m_NrThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	m_pThreadPool = new ThreadPool{ m_NrThreads };
+
+	//Load in textures, decode the normals and pack gloss with specular. The mip chains are built on the thread pool
+	{
+		m_pVehicleDiffuse = Texture::LoadFromFile("Resources/vehicle_diffuse.png", m_pThreadPool, m_TexelLayout);
+		const Texture* pNormal{ Texture::LoadFromFile("Resources/vehicle_normal.png", m_pThreadPool, Texture::TexelLayout::Linear) };
+		const Texture* pGloss{ Texture::LoadFromFile("Resources/vehicle_gloss.png", m_pThreadPool, Texture::TexelLayout::Linear) };
+		const Texture* pSpecular{ Texture::LoadFromFile("Resources/vehicle_specular.png", m_pThreadPool, Texture::TexelLayout::Linear) };
+
+		m_pVehicleNormal = Texture::CreateConverted(*pNormal, DecodeNormal, m_pThreadPool, m_TexelLayout);
+		m_pVehicleSpecularGloss = Texture::CreatePacked(*pSpecular, *pGloss, PackSpecularGloss, m_pThreadPool, m_TexelLayout);
+		assert(m_pVehicleDiffuse && m_pVehicleNormal && m_pVehicleSpecularGloss && "Couldn't pack the vehicle's material");
+
+		const size_t unpackedSize{ m_pVehicleDiffuse->GetMemorySize() + pNormal->GetMemorySize() + pGloss->GetMemorySize() + pSpecular->GetMemorySize() };
+		std::cout << "**(SOFTWARE) Vehicle material packed: diffuse " << m_pVehicleDiffuse->GetMemorySize() / 1024 << " KB, normal "
+			<< m_pVehicleNormal->GetMemorySize() / 1024 << " KB, specular + gloss " << m_pVehicleSpecularGloss->GetMemorySize() / 1024
+			<< " KB (4 maps: " << unpackedSize / 1024 << " KB)\n";
+
+		delete pNormal;
+		delete pGloss;
+		delete pSpecular;
+	}
+
+	//Tiles for the binned renderer
+	m_NrTilesX = (m_Width + TILE_SIZE - 1) / TILE_SIZE;
+	m_NrTilesY = (m_Height + TILE_SIZE - 1) / TILE_SIZE;
+	m_TileBins.resize(static_cast<size_t>(m_NrTilesX) * m_NrTilesY);
+
+	//HiZ blocks, a tile always holds whole blocks
+	m_NrHiZBlocksX = (m_Width + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+	m_NrHiZBlocksY = (m_Height + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+	m_HiZMaxDepth.resize(static_cast<size_t>(m_NrHiZBlocksX) * m_NrHiZBlocksY);
+	m_HiZDirty.resize(m_HiZMaxDepth.size());
 }
 
 Rasterizer_Software::~Rasterizer_Software()
 {
+	delete m_pThreadPool;
 	delete[] m_pDepthBufferPixels;
+	delete[] m_pTriangleIdBuffer;
+	delete[] m_pWeightBuffer;
 	delete m_pVehicleDiffuse;
 	delete m_pVehicleNormal;
-	delete m_pVehicleGloss;
-	delete m_pVehicleSpecular;
+	delete m_pVehicleSpecularGloss;
 	delete m_pVehicleMesh;
 }
 
@@ -59,12 +169,22 @@ void Rasterizer_Software::Render(const ColorRGB& bg)
 
 	const int pixelCount{ m_Width * m_Height };
 	std::fill_n(m_pDepthBufferPixels, pixelCount, INFINITY);
+	std::fill(m_HiZMaxDepth.begin(), m_HiZMaxDepth.end(), INFINITY);
+	std::fill(m_HiZDirty.begin(), m_HiZDirty.end(), uint8_t{ 0 });
+	if (m_UseVisibilityBuffer)
+	{
+		std::fill_n(m_pTriangleIdBuffer, pixelCount, INVALID_TRIANGLE_ID);
+	}
 
 	SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, static_cast<UINT>(bg.r * 255) , static_cast<UINT>( bg.g * 255), static_cast<UINT>( bg.b * 255)));
 
-	m_pVehicleMesh->TransformVertices(m_pCamera, m_Width, m_Height);
+	const uint64_t vertexStart{ SDL_GetPerformanceCounter() };
+	m_pVehicleMesh->TransformVertices(m_pCamera, m_Width, m_Height, m_SimdLevel, m_pThreadPool, m_VertexChunkSize);
+	m_VertexProcessingMs = static_cast<float>(SDL_GetPerformanceCounter() - vertexStart) * 1000.f / static_cast<float>(SDL_GetPerformanceFrequency());
 
+	const uint64_t rasterizationStart{ SDL_GetPerformanceCounter() };
 	RenderTriangleList(m_pVehicleMesh);
+	m_RasterizationMs = static_cast<float>(SDL_GetPerformanceCounter() - rasterizationStart) * 1000.f / static_cast<float>(SDL_GetPerformanceFrequency());
 
 	//@END
 	//Update SDL Surface
@@ -142,202 +262,815 @@ void Rasterizer_Software::ToggleBoundingBox()
 	}
 }
 
+void Rasterizer_Software::ToggleBinning()
+{
+	m_UseBinning = !m_UseBinning;
+	if (m_UseBinning)
+	{
+		std::cout << "**(SOFTWARE) Tiled Multithreaded Rasterization ON (" << m_NrThreads << " threads)\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Tiled Multithreaded Rasterization OFF\n";
+	}
+}
+
+void Rasterizer_Software::ToggleSIMD()
+{
+	m_UseSIMD = !m_UseSIMD;
+	if (m_UseSIMD)
+	{
+		std::cout << "**(SOFTWARE) SIMD Coverage ON\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) SIMD Coverage OFF\n";
+	}
+}
 
+void Rasterizer_Software::CycleTraversalMode()
+{
+	switch (m_CurrentTraversalMode)
+	{
+	case TraversalMode::BoundingBox:
+		std::cout << "**(SOFTWARE) Traversal Mode = SCANLINE\n";
+		m_CurrentTraversalMode = TraversalMode::Scanline;
+		break;
+	case TraversalMode::Scanline:
+		std::cout << "**(SOFTWARE) Traversal Mode = BOUNDING_BOX\n";
+		m_CurrentTraversalMode = TraversalMode::BoundingBox;
+		break;
+	}
+}
 
-void Rasterizer_Software::RenderTriangleList(const Mesh* currentMesh)
+void Rasterizer_Software::ToggleHiZ()
+{
+	m_UseHiZ = !m_UseHiZ;
+	if (m_UseHiZ)
+	{
+		std::cout << "**(SOFTWARE) Hierarchical Z Culling ON\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Hierarchical Z Culling OFF\n";
+	}
+}
+
+void Rasterizer_Software::ToggleVisibilityBuffer()
+{
+	m_UseVisibilityBuffer = !m_UseVisibilityBuffer;
+	if (m_UseVisibilityBuffer)
+	{
+		std::cout << "**(SOFTWARE) Visibility Buffer Shading ON\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Visibility Buffer Shading OFF\n";
+	}
+}
+
+void Rasterizer_Software::CycleCullMode()
+{
+	switch (m_CurrentCullMode)
+	{
+	case CullMode::Back:
+		std::cout << "**(SOFTWARE) Cull Mode = FRONT\n";
+		m_CurrentCullMode = CullMode::Front;
+		break;
+	case CullMode::Front:
+		std::cout << "**(SOFTWARE) Cull Mode = NONE\n";
+		m_CurrentCullMode = CullMode::None;
+		break;
+	case CullMode::None:
+		std::cout << "**(SOFTWARE) Cull Mode = BACK\n";
+		m_CurrentCullMode = CullMode::Back;
+		break;
+	}
+}
+
+void Rasterizer_Software::ToggleFixedPoint()
+{
+	m_UseFixedPoint = !m_UseFixedPoint;
+	if (m_UseFixedPoint)
+	{
+		std::cout << "**(SOFTWARE) Fixed-Point Rasterization ON (top-left rule, scalar)\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Fixed-Point Rasterization OFF\n";
+	}
+}
+
+void Rasterizer_Software::ToggleMipmapping()
+{
+	m_IsMipmappingEnabled = !m_IsMipmappingEnabled;
+	if (m_IsMipmappingEnabled)
+	{
+		std::cout << "**(SOFTWARE) Mipmapping ON\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Mipmapping OFF (full size texture only)\n";
+	}
+}
+
+void Rasterizer_Software::CycleFilterMode()
+{
+	//Texel reads per sample with mipmapping, a sample costs 3 (normal map off) or 4 of them per shaded pixel
+	switch (m_FilterMode)
+	{
+	case Texture::FilterMode::Point:
+		std::cout << "**(SOFTWARE) Sampler Filter = Linear (8 texel reads per sample)\n";
+		m_FilterMode = Texture::FilterMode::Linear;
+		break;
+	case Texture::FilterMode::Linear:
+		std::cout << "**(SOFTWARE) Sampler Filter = Anisotropic (8 to " << 8 * Texture::MAX_ANISOTROPY << " texel reads per sample)\n";
+		m_FilterMode = Texture::FilterMode::Anisotropic;
+		break;
+	case Texture::FilterMode::Anisotropic:
+		std::cout << "**(SOFTWARE) Sampler Filter = Point (1 texel read per sample)\n";
+		m_FilterMode = Texture::FilterMode::Point;
+		break;
+	}
+}
+
+void Rasterizer_Software::ToggleFastMath()
+{
+	m_UseFastMath = !m_UseFastMath;
+	if (m_UseFastMath)
+	{
+		std::cout << "**(SOFTWARE) Fast Math Shading ON\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Fast Math Shading OFF\n";
+	}
+}
+
+void Rasterizer_Software::ToggleWideShading()
+{
+	m_UseWideShading = !m_UseWideShading;
+	if (m_UseWideShading)
+	{
+		std::cout << "**(SOFTWARE) 8-Wide SoA Shading ON\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) 8-Wide SoA Shading OFF (one pixel at a time)\n";
+	}
+}
+
+void Rasterizer_Software::ValidateFastMath()
+{
+	//Every frame is rendered with the exact pipeline, then with the fast one, and the two images are compared channel by channel.
+	//Errors are in 1/255 steps, averaged over the pixels the vehicle covers
+	constexpr int NR_FRAMES{ 36 };
+	const ColorRGB background{ .39f, .39f, .39f };
+	const bool useFastMath{ m_UseFastMath };
+	const int nrPixels{ m_Width * m_Height };
+	std::vector<uint32_t> exactPixels(nrPixels);
+
+	float exactMs{};
+	float fastMs{};
+	int maxError{};
+	uint64_t errorSum{};
+	uint64_t nrCoveredPixels{};
+	uint64_t nrOffPixels{};
+	for (int frame = 0; frame < NR_FRAMES; ++frame)
+	{
+		//One full turn, so the vehicle ends where it started
+		m_pVehicleMesh->RotateY(360.f / NR_FRAMES, 1.f);
+
+		m_UseFastMath = false;
+		Render(background);
+		exactMs += m_RasterizationMs;
+		std::copy(m_pBackBufferPixels, m_pBackBufferPixels + nrPixels, exactPixels.begin());
+
+		m_UseFastMath = true;
+		Render(background);
+		fastMs += m_RasterizationMs;
+
+		for (int i = 0; i < nrPixels; ++i)
+		{
+			if (m_pDepthBufferPixels[i] == INFINITY)
+				continue;
+
+			uint8_t exact[3]{};
+			uint8_t fast[3]{};
+			SDL_GetRGB(exactPixels[i], m_pBackBuffer->format, &exact[0], &exact[1], &exact[2]);
+			SDL_GetRGB(m_pBackBufferPixels[i], m_pBackBuffer->format, &fast[0], &fast[1], &fast[2]);
+
+			int pixelError{};
+			for (int channel = 0; channel < 3; ++channel)
+			{
+				pixelError = std::max(pixelError, std::abs(exact[channel] - fast[channel]));
+			}
+			maxError = std::max(maxError, pixelError);
+			errorSum += pixelError;
+			nrOffPixels += pixelError > 1;
+			++nrCoveredPixels;
+		}
+	}
+	m_UseFastMath = useFastMath;
+
+	const double coveredPixels{ static_cast<double>(std::max(nrCoveredPixels, uint64_t{ 1 })) };
+	std::cout << "**(SOFTWARE) Fast math validation, " << NR_FRAMES << " frames, " << nrCoveredPixels / NR_FRAMES << " covered pixels per frame\n"
+		<< "**(SOFTWARE)\tmax error " << maxError << "/255, mean error " << errorSum / coveredPixels << "/255, "
+		<< 100.0 * nrOffPixels / coveredPixels << "% of the pixels more than 1/255 off\n"
+		<< "**(SOFTWARE)\t" << exactMs / NR_FRAMES << " ms exact, " << fastMs / NR_FRAMES << " ms fast rasterization + shading per frame\n";
+}
+
+void Rasterizer_Software::BenchmarkTextureSampling()
+{
+	//Every frame is timed with the current settings, every TRACE_INTERVAL-th frame is rendered once more on one thread
+	//with every texel address fed straight into the cache model
+	constexpr int NR_FRAMES{ 72 };
+	constexpr int TRACE_INTERVAL{ 8 };
+	constexpr int NR_TRACED_FRAMES{ (NR_FRAMES + TRACE_INTERVAL - 1) / TRACE_INTERVAL };
+	const ColorRGB background{ .39f, .39f, .39f };
+	Texture* textures[]{ m_pVehicleDiffuse, m_pVehicleNormal, m_pVehicleSpecularGloss };
+	const Texture::FilterMode filterMode{ m_FilterMode };
+
+	std::cout << "**(SOFTWARE) Texture sampling benchmark, " << NR_FRAMES << " frames per run, mipmapping " << (m_IsMipmappingEnabled ? "ON" : "OFF") << '\n';
+
+	for (const Texture::FilterMode filter : { Texture::FilterMode::Point, Texture::FilterMode::Linear, Texture::FilterMode::Anisotropic })
+	{
+		m_FilterMode = filter;
+		for (const Texture::TexelLayout layout : { Texture::TexelLayout::Linear, Texture::TexelLayout::Tiled })
+		{
+			for (Texture* pTexture : textures)
+			{
+				pTexture->SetLayout(layout);
+			}
+
+			float rasterizationMs{};
+			uint64_t nrAccesses{};
+			uint64_t nrMisses{};
+			uint64_t nrCoveredPixels{};
+			for (int frame = 0; frame < NR_FRAMES; ++frame)
+			{
+				//One full turn, so the vehicle ends where it started
+				m_pVehicleMesh->RotateY(360.f / NR_FRAMES, 1.f);
+				Render(background);
+				rasterizationMs += m_RasterizationMs;
+
+				if (frame % TRACE_INTERVAL != 0)
+					continue;
+
+				//Recording isn't thread safe, a pool of one thread runs the jobs in order on this thread
+				ThreadPool* pThreadPool{ m_pThreadPool };
+				m_pThreadPool = new ThreadPool{ 1 };
+				CacheModel cache{};
+				for (Texture* pTexture : textures)
+				{
+					pTexture->SetAccessTrace([&cache](uintptr_t address) { cache.Access(address); });
+				}
+
+				Render(background);
+
+				for (Texture* pTexture : textures)
+				{
+					pTexture->SetAccessTrace(nullptr);
+				}
+				delete m_pThreadPool;
+				m_pThreadPool = pThreadPool;
+
+				nrAccesses += cache.GetNrAccesses();
+				nrMisses += cache.GetNrMisses();
+				nrCoveredPixels += std::count_if(m_pDepthBufferPixels, m_pDepthBufferPixels + m_Width * m_Height, [](float depth) { return depth != INFINITY; });
+			}
+
+			//Covered pixels are counted in the traced frames only, they stand in for the whole run
+			const double coveredPixelsPerFrame{ std::max(static_cast<double>(nrCoveredPixels) / NR_TRACED_FRAMES, 1.0) };
+			const char* filterName{ filter == Texture::FilterMode::Point ? "POINT      " : filter == Texture::FilterMode::Linear ? "LINEAR     " : "ANISOTROPIC" };
+			std::cout << "**(SOFTWARE)\t" << filterName << '\t' << (layout == Texture::TexelLayout::Tiled ? "TILED 4x4" : "LINEAR   ")
+				<< '\t' << rasterizationMs / NR_FRAMES << " ms rasterization + shading per frame, "
+				<< 1e6 * rasterizationMs / NR_FRAMES / coveredPixelsPerFrame << " ns and "
+				<< nrAccesses / NR_TRACED_FRAMES / coveredPixelsPerFrame << " texel reads per covered pixel, "
+				<< 100.0 * nrMisses / std::max(nrAccesses, uint64_t{ 1 }) << "% of the reads miss a 32 KB L1\n";
+		}
+	}
+
+	m_FilterMode = filterMode;
+	for (Texture* pTexture : textures)
+	{
+		pTexture->SetLayout(m_TexelLayout);
+	}
+}
+
+void Rasterizer_Software::CycleVertexChunkSize()
+{
+	//0 (serial) -> 1024 -> 4096 -> 16384 -> 65536 -> 0
+	m_VertexChunkSize = m_VertexChunkSize == 0 ? 1024 : m_VertexChunkSize * 4;
+	if (m_VertexChunkSize > 65536)
+	{
+		m_VertexChunkSize = 0;
+	}
+
+	if (m_VertexChunkSize == 0)
+	{
+		std::cout << "**(SOFTWARE) Parallel Vertex Processing OFF\n";
+	}
+	else
+	{
+		std::cout << "**(SOFTWARE) Parallel Vertex Processing ON (" << m_VertexChunkSize << " vertices per chunk)\n";
+	}
+}
+
+void Rasterizer_Software::PrintStats() const
+{
+	std::cout << "**(SOFTWARE) Vertex processing: " << m_VertexProcessingMs << " ms";
+	if (m_VertexChunkSize == 0)
+	{
+		std::cout << " (serial)\n";
+	}
+	else
+	{
+		std::cout << " (" << m_VertexChunkSize << " vertices per chunk, " << m_NrThreads << " threads)\n";
+	}
+	std::cout << "**(SOFTWARE) Rasterization + shading: " << m_RasterizationMs << " ms (" << CpuFeatures::GetName(m_SimdLevel) << " kernels)\n";
+
+	std::cout << "**(SOFTWARE) Triangles: " << m_SetupStats.nrSubmitted << " submitted, " << m_NrRasterizedTriangles << " rasterized. Culled "
+		<< m_SetupStats.nrOutsideFrustum << " outside frustum, "
+		<< m_SetupStats.nrClipped << " clipped, "
+		<< m_SetupStats.nrFacing << " facing, "
+		<< m_SetupStats.nrDegenerate << " degenerate, "
+		<< m_SetupStats.nrSubPixel << " sub-pixel";
+	if (m_UseHiZ)
+	{
+		std::cout << ", HiZ rejected " << m_NrHiZRejectedTriangles << " triangles and " << m_HiZRejectedBlocks << " blocks";
+	}
+	std::cout << '\n';
+}
+
+void Rasterizer_Software::CycleThreadCount()
+{
+	//Powers of two up to 64 plus the amount of hardware threads, so scaling can be measured on any machine
+	const int hardwareThreads{ std::max(1, static_cast<int>(std::thread::hardware_concurrency())) };
+	const int maxThreads{ 64 };
+
+	int nextCount{ 1 };
+	while (nextCount <= m_NrThreads)
+	{
+		nextCount *= 2;
+	}
+	if (m_NrThreads < hardwareThreads && hardwareThreads < nextCount)
+	{
+		nextCount = hardwareThreads;
+	}
+	m_NrThreads = nextCount > std::max(maxThreads, hardwareThreads) ? 1 : nextCount;
+
+	delete m_pThreadPool;
+	m_pThreadPool = new ThreadPool{ m_NrThreads };
+
+	std::cout << "**(SOFTWARE) Worker Threads = " << m_NrThreads << '\n';
+}
+
+void Rasterizer_Software::RenderTriangleList(Mesh* currentMesh)
 {
-	const std::vector<Vertex_Out>& verticesOut{ currentMesh->GetVerticesOut() };
 	const std::vector<uint32_t>& indices{ currentMesh->GetIndices() };
 
+	m_Triangles.clear();
+	m_SetupStats = SetupStats{};
 	for (size_t idx = 0; idx < indices.size(); idx += 3)
 	{
-		LoopOverPixels(
-			verticesOut[indices[idx]],
-			verticesOut[indices[idx + 1]],
-			verticesOut[indices[idx + 2]]);
+		AddTriangle(currentMesh, indices[idx], indices[idx + 1], indices[idx + 2]);
 	}
+
+	(this->*SelectPipeline())(VertexStreams{ currentMesh->GetPositionsOut(), currentMesh->GetVaryingsOut() });
 }
 
-void Rasterizer_Software::RenderTriangleStrip(const Mesh* currentMesh)
+void Rasterizer_Software::RenderTriangleStrip(Mesh* currentMesh)
 {
-	const std::vector<Vertex_Out>& verticesOut{ currentMesh->GetVerticesOut() };
 	const std::vector<uint32_t>& indices{ currentMesh->GetIndices() };
 
+	m_Triangles.clear();
+	m_SetupStats = SetupStats{};
 	for (size_t idx = 0; idx < indices.size() - 2; ++idx)
 	{
-
 		if (idx % 2 == 0)
 		{
-			LoopOverPixels(
-				verticesOut[indices[idx]],
-				verticesOut[indices[idx + 1]],
-				verticesOut[indices[idx + 2]]);
+			AddTriangle(currentMesh, indices[idx], indices[idx + 1], indices[idx + 2]);
 		}
 		else
 		{
 			//Fix counterclockwise order
-			LoopOverPixels(
-				verticesOut[indices[idx]],
-				verticesOut[indices[idx + 2]],
-				verticesOut[indices[idx + 1]]);
+			AddTriangle(currentMesh, indices[idx], indices[idx + 2], indices[idx + 1]);
 		}
-
 	}
+
+	(this->*SelectPipeline())(VertexStreams{ currentMesh->GetPositionsOut(), currentMesh->GetVaryingsOut() });
 }
 
-void Rasterizer_Software::LoopOverPixels(const Vertex_Out& ver0, const Vertex_Out& ver1, const Vertex_Out& ver2)
+void Rasterizer_Software::AddTriangle(Mesh* pMesh, uint32_t idx0, uint32_t idx1, uint32_t idx2)
 {
+	++m_SetupStats.nrSubmitted;
 
-	//Frustrum culling
-	if (ver0.Position.z < 0.f || ver0.Position.z > 1.f)
-		return;
-	if (ver1.Position.z < 0.f || ver1.Position.z > 1.f)
+	const std::vector<Vector4>& clipPositions{ pMesh->GetClipPositions() };
+	const uint32_t clipCode0{ GetClipCode(clipPositions[idx0]) };
+	const uint32_t clipCode1{ GetClipCode(clipPositions[idx1]) };
+	const uint32_t clipCode2{ GetClipCode(clipPositions[idx2]) };
+
+	//All three vertices outside the same plane
+	if ((clipCode0 & clipCode1 & clipCode2) != 0)
+	{
+		++m_SetupStats.nrOutsideFrustum;
 		return;
-	if (ver2.Position.z < 0.f || ver2.Position.z > 1.f)
+	}
+
+	//Inside near/far and inside the guard band: no clipping needed, the raster loops only visit the on screen part of the bounding box
+	if ((clipCode0 | clipCode1 | clipCode2) == 0)
+	{
+		SubmitTriangle(pMesh->GetPositionsOut(), idx0, idx1, idx2);
 		return;
+	}
+
+	++m_SetupStats.nrClipped;
+	ClipTriangle(pMesh, idx0, idx1, idx2);
+}
+
+uint32_t Rasterizer_Software::GetClipCode(const Vector4& clipPosition)
+{
+	const float guardBand{ GUARD_BAND * clipPosition.w };
 
-	Vector2 v0 = ver0.Position.GetXY();
-	Vector2 v1 = ver1.Position.GetXY();
-	Vector2 v2 = ver2.Position.GetXY();
+	uint32_t clipCode{};
+	if (clipPosition.z < 0.f)
+		clipCode |= 1u << static_cast<int>(ClipPlane::Near);
+	if (clipPosition.z > clipPosition.w)
+		clipCode |= 1u << static_cast<int>(ClipPlane::Far);
+	if (clipPosition.x < -guardBand)
+		clipCode |= 1u << static_cast<int>(ClipPlane::Left);
+	if (clipPosition.x > guardBand)
+		clipCode |= 1u << static_cast<int>(ClipPlane::Right);
+	if (clipPosition.y < -guardBand)
+		clipCode |= 1u << static_cast<int>(ClipPlane::Bottom);
+	if (clipPosition.y > guardBand)
+		clipCode |= 1u << static_cast<int>(ClipPlane::Top);
+	return clipCode;
+}
 
-	Vector2 topLeft{};
-	topLeft.x = std::min(std::min(v0.x, v1.x), v2.x);
-	topLeft.y = std::min(std::min(v0.y, v1.y), v2.y);
+float Rasterizer_Software::GetClipDistance(const Vector4& clipPosition, ClipPlane plane)
+{
+	//Positive inside, 0 on the plane
+	switch (plane)
+	{
+	case ClipPlane::Near:
+		return clipPosition.z;
+	case ClipPlane::Far:
+		return clipPosition.w - clipPosition.z;
+	case ClipPlane::Left:
+		return clipPosition.x + GUARD_BAND * clipPosition.w;
+	case ClipPlane::Right:
+		return GUARD_BAND * clipPosition.w - clipPosition.x;
+	case ClipPlane::Bottom:
+		return clipPosition.y + GUARD_BAND * clipPosition.w;
+	case ClipPlane::Top:
+		return GUARD_BAND * clipPosition.w - clipPosition.y;
+	}
+	return 0.f;
+}
 
-	Vector2 bottomRight{};
-	bottomRight.x = std::max(std::max(v0.x, v1.x), v2.x);
-	bottomRight.y = std::max(std::max(v0.y, v1.y), v2.y);
+void Rasterizer_Software::ClipTriangle(Mesh* pMesh, uint32_t idx0, uint32_t idx1, uint32_t idx2)
+{
+	//Sutherland-Hodgman in clip space, before the perspective divide, where every attribute is still linear.
+	//Every plane adds at most one vertex, so the polygon never grows past 3 + NR_CLIP_PLANES vertices
+	struct ClipVertex
+	{
+		Vector4 position{};			//Clip space
+		Vertex_Varyings varyings{};
+		uint32_t idx{};				//Index in the mesh output streams, INVALID_VERTEX_IDX for new vertices
+	};
+	constexpr int maxClipVertices{ 3 + NR_CLIP_PLANES };
+	constexpr uint32_t INVALID_VERTEX_IDX{ UINT32_MAX };
 
+	ClipVertex polygon[maxClipVertices]{};
+	ClipVertex clipped[maxClipVertices]{};
+	int nrVertices{ 3 };
 
-	Vector3 weight{};
-	for (int px{ std::max(0,static_cast<int>(topLeft.x)) }; px <= std::min(m_Width, static_cast<int>(bottomRight.x)); ++px)
+	const std::vector<Vector4>& clipPositions{ pMesh->GetClipPositions() };
+	const uint32_t indices[3]{ idx0, idx1, idx2 };
+	for (int i{ 0 }; i < 3; ++i)
 	{
-		for (int py{ std::max(0,static_cast<int>(topLeft.y)) }; py <= std::min(m_Height, static_cast<int>(bottomRight.y)); ++py)
+		polygon[i].position = clipPositions[indices[i]];
+		polygon[i].varyings = pMesh->GetVaryingsOut()[indices[i]];
+		polygon[i].idx = indices[i];
+	}
+
+	for (int planeIdx{ 0 }; planeIdx < NR_CLIP_PLANES && nrVertices >= 3; ++planeIdx)
+	{
+		const ClipPlane plane{ static_cast<ClipPlane>(planeIdx) };
+		int nrClipped{ 0 };
+
+		for (int i{ 0 }; i < nrVertices; ++i)
 		{
-			Vector2 pixel{ static_cast<float>(px), static_cast<float>(py) };
-			if (m_UseBoundingBoxVisualization)
+			const ClipVertex& current{ polygon[i] };
+			const ClipVertex& next{ polygon[(i + 1) % nrVertices] };
+			const float currentDistance{ GetClipDistance(current.position, plane) };
+			const float nextDistance{ GetClipDistance(next.position, plane) };
+
+			if (currentDistance >= 0.f)
 			{
-				ColorRGB finalColor{ 1.f,1.f,1.f };
-				//Update Color in Buffer
-				finalColor.MaxToOne();
-
-				m_pBackBufferPixels[px + (static_cast<int>(py) * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255));
-				continue;
+				clipped[nrClipped++] = current;
 			}
-			if (Utils::IsInsideTriangle(pixel, v0, v1, v2, weight))
+
+			//Edge crosses the plane: add the intersection
+			if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
 			{
-				//Z interpolated non-linear
-				float currentDepth = 1.f / (weight.x / ver0.Position.z + weight.y / ver1.Position.z + weight.z / ver2.Position.z);
+				const float t{ currentDistance / (currentDistance - nextDistance) };
+				const Vertex_Varyings& a{ current.varyings };
+				const Vertex_Varyings& b{ next.varyings };
 
-				if (currentDepth < m_pDepthBufferPixels[px + (py * m_Width)])
+				ClipVertex& intersection{ clipped[nrClipped++] };
+				intersection.idx = INVALID_VERTEX_IDX;
+				intersection.position = current.position + (next.position - current.position) * t;
+				intersection.varyings.Uv = a.Uv + (b.Uv - a.Uv) * t;
+				intersection.varyings.Normal = a.Normal + (b.Normal - a.Normal) * t;
+				intersection.varyings.Tangent = a.Tangent + (b.Tangent - a.Tangent) * t;
+				intersection.varyings.ViewDirection = a.ViewDirection + (b.ViewDirection - a.ViewDirection) * t;
+
+				//Put the vertex exactly on the plane, so a rounding error can't make it fail the same test again
+				Vector4& position{ intersection.position };
+				switch (plane)
 				{
-					//Z-interpolated, linear
-					float wBuffer{ 1 / (1 / ver0.Position.w * weight.x + 1 / ver1.Position.w * weight.y + 1 / ver2.Position.w * weight.z) };
-					Vector2 uv{};
-					uv = (
-						ver0.Uv / ver0.Position.w * weight.x +
-						ver1.Uv / ver1.Position.w * weight.y +
-						ver2.Uv / ver2.Position.w * weight.z) * wBuffer;
-
-					Vector3 normal{ (
-						ver0.Normal * weight.x * ver0.Position.w +
-						ver1.Normal * weight.y * ver1.Position.w +
-						ver2.Normal * weight.z * ver2.Position.w) * wBuffer };
-
-					normal.Normalize();
-
-					Vector3 tangent{ (
-						ver0.Tangent * weight.x * ver0.Position.w +
-						ver1.Tangent * weight.y * ver1.Position.w +
-						ver2.Tangent * weight.z * ver2.Position.w) * wBuffer };
-					tangent.Normalize();
-
-					Vector3 viewDir{ (
-						ver0.ViewDirection * weight.x * ver0.Position.w +
-						ver1.ViewDirection * weight.y * ver1.Position.w +
-						ver2.ViewDirection * weight.z * ver2.Position.w) * wBuffer };
-					viewDir.Normalize();
-
-					Vertex_Out currentPixel
-					{
-						Vector4{static_cast<float>(px),static_cast<float>(py),currentDepth,wBuffer},
-						uv,
-						normal,
-						tangent,
-						viewDir
-					};
-
-					m_pDepthBufferPixels[px + (py * m_Width)] = currentDepth;
-
-					PixelShading(currentPixel);
+				case ClipPlane::Near:
+					position.z = 0.f;
+					break;
+				case ClipPlane::Far:
+					position.z = position.w;
+					break;
+				case ClipPlane::Left:
+					position.x = -GUARD_BAND * position.w;
+					break;
+				case ClipPlane::Right:
+					position.x = GUARD_BAND * position.w;
+					break;
+				case ClipPlane::Bottom:
+					position.y = -GUARD_BAND * position.w;
+					break;
+				case ClipPlane::Top:
+					position.y = GUARD_BAND * position.w;
+					break;
 				}
-
 			}
 		}
+
+		std::copy_n(clipped, nrClipped, polygon);
+		nrVertices = nrClipped;
+	}
+
+	if (nrVertices < 3)
+	{
+		++m_SetupStats.nrOutsideFrustum;
+		return;
+	}
+
+	//New vertices go to screen space and are added to the mesh output, original ones keep their index
+	for (int i{ 0 }; i < nrVertices; ++i)
+	{
+		if (polygon[i].idx == INVALID_VERTEX_IDX)
+		{
+			polygon[i].idx = pMesh->AddVertexOut(Mesh::ClipToScreen(polygon[i].position, m_Width, m_Height), polygon[i].varyings);
+		}
+	}
+
+	//The polygon is convex and keeps the winding of the triangle, so a fan covers it
+	for (int i{ 1 }; i + 1 < nrVertices; ++i)
+	{
+		SubmitTriangle(pMesh->GetPositionsOut(), polygon[0].idx, polygon[i].idx, polygon[i + 1].idx);
 	}
 }
 
-void Rasterizer_Software::PixelShading(const Vertex_Out& v)
+void Rasterizer_Software::SubmitTriangle(const std::vector<Vector4>& positions, uint32_t idx0, uint32_t idx1, uint32_t idx2)
 {
-	ColorRGB finalColor{};
-	float remapped{};
-	const float intensity{ 7.f };
-	const float shininess{ 25.f };
+	//Only triangles that survive setup end up in m_Triangles, so rasterization never sees a culled one
+	TriangleSetup triangle{};
 
-	Vector3 binormal{ Vector3::Cross(v.Normal,v.Tangent) };
-	Matrix tangentSpaceAxis = Matrix{ v.Tangent,binormal,v.Normal,Vector3::Zero };
+	switch (SetupTriangle(positions, idx0, idx1, idx2, triangle))
+	{
+	case SetupResult::Visible:
+		m_Triangles.push_back(triangle);
+		break;
+	case SetupResult::OutsideFrustum:
+		++m_SetupStats.nrOutsideFrustum;
+		break;
+	case SetupResult::Facing:
+		++m_SetupStats.nrFacing;
+		break;
+	case SetupResult::Degenerate:
+		++m_SetupStats.nrDegenerate;
+		break;
+	case SetupResult::SubPixel:
+		++m_SetupStats.nrSubPixel;
+		break;
+	}
+}
 
-	ColorRGB normalSample{ m_pVehicleNormal->Sample(v.Uv) };
-	Vector3 normalSampleVec{ normalSample.r,normalSample.g,normalSample.b };
+Rasterizer_Software::SetupResult Rasterizer_Software::SetupTriangle(const std::vector<Vector4>& positions, uint32_t idx0, uint32_t idx1, uint32_t idx2, TriangleSetup& triangle) const
+{
+	if (m_UseFixedPoint)
+		return SetupTriangleFixed(positions, idx0, idx1, idx2, triangle);
 
-	Vector3 normal{ 2.f * normalSampleVec - Vector3{1.f,1.f,1.f} };
-	normal = m_UseNormalMap ? tangentSpaceAxis.TransformVector(normal).Normalized() : v.Normal;
+	const Vector4& p0{ positions[idx0] };
+	const Vector4& p1{ positions[idx1] };
+	const Vector4& p2{ positions[idx2] };
 
-	const float lambertCosine{ Vector3::Dot(normal, -m_LightDirection) };
+	//Edge functions: E(x,y) = A * x + B * y + C, one per edge, stored in x/y/z in the same order as the weights.
+	//Each one is the cross product of (pixel - vertex) and the edge, expanded so it is linear in x and y
+	triangle.edgeA = Vector3{ p2.y - p1.y, p0.y - p2.y, p1.y - p0.y };
+	triangle.edgeB = Vector3{ p1.x - p2.x, p2.x - p0.x, p0.x - p1.x };
+	triangle.edgeC = Vector3{
+		-(p1.x * triangle.edgeA.x + p1.y * triangle.edgeB.x),
+		-(p2.x * triangle.edgeA.y + p2.y * triangle.edgeB.y),
+		-(p0.x * triangle.edgeA.z + p0.y * triangle.edgeB.z) };
 
-	if (m_CurrentShadingMode == ShadingMode::DepthBuffer)
+	//Left handed --> clockwise (front facing) is negative
+	float totalArea{ (p0.x - p1.x) * triangle.edgeA.x + (p0.y - p1.y) * triangle.edgeB.x };
+	if (totalArea == 0.f || std::isnan(totalArea))
+		return SetupResult::Degenerate;
+
+	const bool isFrontFacing{ totalArea < 0.f };
+	if ((m_CurrentCullMode == CullMode::Back && !isFrontFacing) || (m_CurrentCullMode == CullMode::Front && isFrontFacing))
+		return SetupResult::Facing;
+
+	//The raster loops expect inside to be negative, so back faces get their edge functions flipped.
+	//Flipping the area as well leaves the weights untouched
+	if (!isFrontFacing)
 	{
-		remapped = Remap(v.Position.z);
-		finalColor = { remapped,remapped,remapped };
+		triangle.edgeA = -triangle.edgeA;
+		triangle.edgeB = -triangle.edgeB;
+		triangle.edgeC = -triangle.edgeC;
+		totalArea = -totalArea;
 	}
-	else
+
+	triangle.invArea = 1.f / totalArea;
+	triangle.weightDdx = triangle.edgeA * triangle.invArea;
+	triangle.weightDdy = triangle.edgeB * triangle.invArea;
+	triangle.depth = Vector3{ p0.z, p1.z, p2.z };
+	triangle.minDepth = std::min(std::min(p0.z, p1.z), p2.z);
+
+	//Bounding box, clamped to the screen
+	const float minX{ std::min(std::min(p0.x, p1.x), p2.x) };
+	const float minY{ std::min(std::min(p0.y, p1.y), p2.y) };
+	const float maxX{ std::max(std::max(p0.x, p1.x), p2.x) };
+	const float maxY{ std::max(std::max(p0.y, p1.y), p2.y) };
+
+	if (maxX < 0.f || maxY < 0.f || minX >= m_Width || minY >= m_Height)
+		return SetupResult::OutsideFrustum;
+
+	triangle.min = Int2{ static_cast<int>(std::max(minX, 0.f)), static_cast<int>(std::max(minY, 0.f)) };
+	triangle.max = Int2{ static_cast<int>(std::min(maxX, static_cast<float>(m_Width - 1))), static_cast<int>(std::min(maxY, static_cast<float>(m_Height - 1))) };
+
+	//Pixels are sampled at integer coordinates, a triangle whose bounding box holds none of them can't cover a pixel
+	if (ceilf(minX) > maxX || ceilf(minY) > maxY)
+		return SetupResult::SubPixel;
+
+	triangle.idx0 = idx0;
+	triangle.idx1 = idx1;
+	triangle.idx2 = idx2;
+
+	return SetupResult::Visible;
+}
+
+Rasterizer_Software::SetupResult Rasterizer_Software::SetupTriangleFixed(const std::vector<Vector4>& positions, uint32_t idx0, uint32_t idx1, uint32_t idx2, TriangleSetup& triangle) const
+{
+	const Vector4& p0{ positions[idx0] };
+	const Vector4& p1{ positions[idx1] };
+	const Vector4& p2{ positions[idx2] };
+
+	//Snap the vertices to the sub-pixel grid, everything after this is exact integer math.
+	//Inside the guard band coordinates stay below 2^24 sub-pixels even at 8K, so A and B fit in 32 bits and C/E in 64 bits
+	const auto snap = [](float coordinate) { return static_cast<int64_t>(std::lround(coordinate * SUBPIXEL_SCALE)); };
+	const int64_t x0{ snap(p0.x) }, y0{ snap(p0.y) };
+	const int64_t x1{ snap(p1.x) }, y1{ snap(p1.y) };
+	const int64_t x2{ snap(p2.x) }, y2{ snap(p2.y) };
+
+	//Same edge functions as the float path, in 1/SUBPIXEL_SCALE^2 pixel units
+	int64_t edgeA[3]{ y2 - y1, y0 - y2, y1 - y0 };
+	int64_t edgeB[3]{ x1 - x2, x2 - x0, x0 - x1 };
+	int64_t edgeC[3]{ -(x1 * edgeA[0] + y1 * edgeB[0]), -(x2 * edgeA[1] + y2 * edgeB[1]), -(x0 * edgeA[2] + y0 * edgeB[2]) };
+
+	int64_t totalArea{ (x0 - x1) * edgeA[0] + (y0 - y1) * edgeB[0] };
+	if (totalArea == 0)
+		return SetupResult::Degenerate;
+
+	const bool isFrontFacing{ totalArea < 0 };
+	if ((m_CurrentCullMode == CullMode::Back && !isFrontFacing) || (m_CurrentCullMode == CullMode::Front && isFrontFacing))
+		return SetupResult::Facing;
+
+	if (!isFrontFacing)
 	{
-		if (lambertCosine > 0.f)
+		for (int edge{ 0 }; edge < 3; ++edge)
 		{
-			//Phong
-			Vector3 reflect = -m_LightDirection - 2 * std::max(Vector3::Dot(normal, -m_LightDirection), 0.f) * normal;
-			float alpha = std::max(Vector3::Dot(reflect, v.ViewDirection), 0.f);
-			ColorRGB specular = m_pVehicleSpecular->Sample(v.Uv) * powf(alpha, shininess * m_pVehicleGloss->Sample(v.Uv).r);
+			edgeA[edge] = -edgeA[edge];
+			edgeB[edge] = -edgeB[edge];
+			edgeC[edge] = -edgeC[edge];
+		}
+		totalArea = -totalArea;
+	}
 
-			ColorRGB ambient{ .025f,.025f, .025f };
-			ColorRGB diffuse{ Utils::Lambert(intensity, m_pVehicleDiffuse->Sample(v.Uv)) };
+	//Top-left rule: a pixel exactly on an edge only belongs to the triangle when that edge is a top or a left edge.
+	//(A, B) points out of the triangle, so a left edge has A < 0 and a top edge (y points down) A == 0 and B < 0.
+	//Inside is E < 0, subtracting 1 from C turns that into E <= 0 for top-left edges.
+	//Two triangles sharing an edge see it with opposite directions, so exactly one of them gets the pixels on it
+	for (int edge{ 0 }; edge < 3; ++edge)
+	{
+		const bool isTopLeft{ edgeA[edge] < 0 || (edgeA[edge] == 0 && edgeB[edge] < 0) };
+		triangle.fixedEdgeA[edge] = static_cast<int32_t>(edgeA[edge]);
+		triangle.fixedEdgeB[edge] = static_cast<int32_t>(edgeB[edge]);
+		triangle.fixedEdgeC[edge] = edgeC[edge] - (isTopLeft ? 1 : 0);
+	}
 
-			switch (m_CurrentShadingMode)
-			{
-			case ShadingMode::Combined:
-				finalColor = (diffuse + specular + ambient) * lambertCosine;
-				break;
-			case ShadingMode::Diffuse:
-				finalColor = diffuse * lambertCosine;
-				break;
-			case ShadingMode::ObservedArea:
-				finalColor = ColorRGB{ lambertCosine,lambertCosine,lambertCosine };
-				break;
-			case ShadingMode::Specular:
-				finalColor = specular * lambertCosine;
-				break;
-			}
+	triangle.invArea = 1.f / static_cast<float>(totalArea);
+	//One pixel is SUBPIXEL_SCALE steps on the grid
+	triangle.weightDdx = Vector3{ static_cast<float>(triangle.fixedEdgeA[0]), static_cast<float>(triangle.fixedEdgeA[1]), static_cast<float>(triangle.fixedEdgeA[2]) } * (SUBPIXEL_SCALE * triangle.invArea);
+	triangle.weightDdy = Vector3{ static_cast<float>(triangle.fixedEdgeB[0]), static_cast<float>(triangle.fixedEdgeB[1]), static_cast<float>(triangle.fixedEdgeB[2]) } * (SUBPIXEL_SCALE * triangle.invArea);
+	triangle.depth = Vector3{ p0.z, p1.z, p2.z };
+	triangle.minDepth = std::min(std::min(p0.z, p1.z), p2.z);
+
+	//Pixels whose sample lies inside the snapped bounding box, rounded inwards
+	const int64_t minX{ (std::min(std::min(x0, x1), x2) + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS };
+	const int64_t minY{ (std::min(std::min(y0, y1), y2) + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS };
+	const int64_t maxX{ std::max(std::max(x0, x1), x2) >> SUBPIXEL_BITS };
+	const int64_t maxY{ std::max(std::max(y0, y1), y2) >> SUBPIXEL_BITS };
+
+	if (maxX < 0 || maxY < 0 || minX >= m_Width || minY >= m_Height)
+		return SetupResult::OutsideFrustum;
+
+	if (minX > maxX || minY > maxY)
+		return SetupResult::SubPixel;
+
+	triangle.min = Int2{ static_cast<int>(std::max<int64_t>(minX, 0)), static_cast<int>(std::max<int64_t>(minY, 0)) };
+	triangle.max = Int2{ static_cast<int>(std::min<int64_t>(maxX, m_Width - 1)), static_cast<int>(std::min<int64_t>(maxY, m_Height - 1)) };
+
+	triangle.idx0 = idx0;
+	triangle.idx1 = idx1;
+	triangle.idx2 = idx2;
+
+	return SetupResult::Visible;
+}
+
+Rasterizer_Software::RasterizeFunction Rasterizer_Software::SelectPipeline() const
+{
+	switch (m_SimdLevel)
+	{
+	case SimdLevel::AVX512:
+		return SelectPipeline<SimdLevel::AVX512>();
+	case SimdLevel::AVX2:
+		return SelectPipeline<SimdLevel::AVX2>();
+	default:
+		return SelectPipeline<SimdLevel::SSE4>();
+	}
+}
+
+void Rasterizer_Software::MarkHiZDirty(int px, int py)
+{
+	m_HiZDirty[px / HIZ_BLOCK_SIZE + (py / HIZ_BLOCK_SIZE) * m_NrHiZBlocksX] = 1;
+}
+
+void Rasterizer_Software::UpdateHiZBlock(int blockIdx)
+{
+	const int minX{ (blockIdx % m_NrHiZBlocksX) * HIZ_BLOCK_SIZE };
+	const int minY{ (blockIdx / m_NrHiZBlocksX) * HIZ_BLOCK_SIZE };
+	const int maxX{ std::min(minX + HIZ_BLOCK_SIZE, m_Width) };
+	const int maxY{ std::min(minY + HIZ_BLOCK_SIZE, m_Height) };
+
+	float maxDepth{ 0.f };
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		const float* pDepth{ m_pDepthBufferPixels + py * m_Width };
+		for (int px{ minX }; px < maxX; ++px)
+		{
+			maxDepth = std::max(maxDepth, pDepth[px]);
 		}
 	}
 
-	//Update Color in Buffer
-	finalColor.MaxToOne();
+	m_HiZMaxDepth[blockIdx] = maxDepth;
+	m_HiZDirty[blockIdx] = 0;
+}
 
-	m_pBackBufferPixels[static_cast<int>(v.Position.x) + (static_cast<int>(v.Position.y) * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+uint32_t Rasterizer_Software::GetOccludedBlocks(float minDepth, int blockY, int firstBlockX, int lastBlockX)
+{
+	assert(lastBlockX - firstBlockX < 32 && "More HiZ blocks than bits in the mask");
+
+	//Blocks only ever get closer, so a block rejected now stays rejected for the rest of the triangle
+	uint32_t occludedBlocks{};
+	for (int blockX{ firstBlockX }; blockX <= lastBlockX; ++blockX)
+	{
+		const int blockIdx{ blockX + blockY * m_NrHiZBlocksX };
+		if (m_HiZDirty[blockIdx])
+		{
+			UpdateHiZBlock(blockIdx);
+		}
+
+		if (minDepth >= m_HiZMaxDepth[blockIdx])
+		{
+			occludedBlocks |= 1u << (blockX - firstBlockX);
+		}
+	}
+	return occludedBlocks;
+}
+
+Vector4 Rasterizer_Software::SampleTexture(const Texture* pTexture, const Vertex_Out& v) const
+{
+	return pTexture->SampleRGBA(v.Uv, v.UvDdx, v.UvDdy, m_FilterMode, m_IsMipmappingEnabled);
 }
@@ -1,16 +1,20 @@
 #pragma once
 #include "DataTypes.h"
+#include "Texture.h"
+#include "CpuFeatures.h"
+#include <atomic>
 
 struct SDL_Window;
 class Mesh;
-class Texture;
+class ThreadPool;
 struct Camera;
 
 class Rasterizer_Software final
 {
 
 public:
-	Rasterizer_Software(SDL_Window* pWindow, int w, int h, Camera* pCamera);
+	//simdLevel picks the kernels raster, shading and the vertex transform run with, the CPU has to support it
+	Rasterizer_Software(SDL_Window* pWindow, int w, int h, Camera* pCamera, dae::SimdLevel simdLevel);
 	~Rasterizer_Software();
 
 	Rasterizer_Software(const Rasterizer_Software&) = delete;
@@ -27,13 +31,153 @@ public:
 	void ToggleDepthBuffer();
 	void ToggleNormalMap();
 	void ToggleBoundingBox();
+	void ToggleBinning();
+	void CycleThreadCount();
+	void ToggleSIMD();
+	void CycleTraversalMode();
+	void ToggleHiZ();
+	void ToggleVisibilityBuffer();
+	void CycleCullMode();
+	void ToggleFixedPoint();
+	void CycleVertexChunkSize();
+	void ToggleMipmapping();
+	void CycleFilterMode();
+	void ToggleFastMath();
+	void ToggleWideShading();
+	//Renders a full turn of the vehicle with the exact and the fast math pipeline and prints how far the fast images are off
+	void ValidateFastMath();
+	//Renders a full turn of the vehicle per filter mode and texel layout, prints raster + shading time, per pixel cost and texture cache misses
+	void BenchmarkTextureSampling();
+
+	//Counters of the last rendered frame
+	void PrintStats() const;
 
 private:
+	//Screen is split in square tiles, the binned renderer hands out one tile per job
+	static constexpr int TILE_SIZE{ 64 };
+	//Columns handled together by the coverage test (8 SIMD lanes), TILE_SIZE is a multiple of it
+	static constexpr int PIXEL_GROUP_SIZE{ 8 };
+	//Side of a HiZ block, one group wide and as many rows high
+	static constexpr int HIZ_BLOCK_SIZE{ PIXEL_GROUP_SIZE };
+	//The blocks one tile row touches are a bit each in a 32 bit mask (GetOccludedBlocks)
+	static_assert(TILE_SIZE / HIZ_BLOCK_SIZE + 1 <= 32, "A tile is too wide for the HiZ block masks");
+	//Triangles only get clipped against x/y once they leave this band around the screen (in NDC, the screen is -1 to 1).
+	//Inside it the edge functions still have plenty of float precision
+	static constexpr float GUARD_BAND{ 8.f };
+	//Fixed-point mode snaps vertices to a 1/256 pixel grid (24.8)
+	static constexpr int SUBPIXEL_BITS{ 8 };
+	static constexpr int64_t SUBPIXEL_SCALE{ 1 << SUBPIXEL_BITS };
+	//Triangle id of a pixel nothing was drawn on
+	static constexpr uint32_t INVALID_TRIANGLE_ID{ UINT32_MAX };
+
+	//Everything the rasterizer needs from a triangle, computed once before any pixel is touched
+	struct TriangleSetup
+	{
+		dae::Vector3 edgeA{};
+		dae::Vector3 edgeB{};
+		dae::Vector3 edgeC{};
+		float invArea{};
+		//Depth of the three vertices, so the raster loops never fetch vertex data
+		dae::Vector3 depth{};
+		//Closest vertex depth, interpolated depth is clamped to it so no fragment of the triangle can be in front of it
+		float minDepth{};
+		//How much the weights change from one pixel to the next, horizontally and vertically
+		dae::Vector3 weightDdx{};
+		dae::Vector3 weightDdy{};
+
+		Int2 min{};
+		Int2 max{};
+
+		//Fixed-point mode only: edge functions on the sub-pixel grid, C includes the top-left bias
+		int32_t fixedEdgeA[3]{};
+		int32_t fixedEdgeB[3]{};
+		int64_t fixedEdgeC[3]{};
+
+		uint32_t idx0{};
+		uint32_t idx1{};
+		uint32_t idx2{};
+	};
+
+	//Output streams of the mesh being drawn. Setup and raster only read positions, shading also reads the varyings
+	struct VertexStreams
+	{
+		const std::vector<dae::Vector4>& positions;
+		const std::vector<Vertex_Varyings>& varyings;
+	};
+
 	enum class ShadingMode
 	{
 		Combined, Diffuse, ObservedArea, Specular, DepthBuffer
 	};
 
+	//Compile time shading configuration. Everything from RasterizeTriangles down to PixelShading is instantiated per pipeline,
+	//so pixels never branch on these settings and only interpolate and sample what their mode uses.
+	//Pipelines are instantiated by the kernels of their SIMD level only (Rasterizer_Software_Kernels.inl)
+	template<dae::SimdLevel SIMD_LEVEL, ShadingMode SHADING_MODE, bool USE_NORMAL_MAP, bool SHOW_BOUNDING_BOX, bool USE_FAST_MATH = false>
+	struct PixelPipeline
+	{
+		static constexpr dae::SimdLevel simdLevel{ SIMD_LEVEL };
+		static constexpr ShadingMode shadingMode{ SHADING_MODE };
+		static constexpr bool showBoundingBox{ SHOW_BOUNDING_BOX };
+		static constexpr bool isLit{ SHADING_MODE != ShadingMode::DepthBuffer };
+		static constexpr bool useNormalMap{ USE_NORMAL_MAP && isLit };
+		//Approximate pow and normalization, fewer divides. ValidateFastMath measures what that costs in accuracy
+		static constexpr bool useFastMath{ USE_FAST_MATH && isLit };
+		static constexpr bool needsDiffuse{ SHADING_MODE == ShadingMode::Combined || SHADING_MODE == ShadingMode::Diffuse };
+		static constexpr bool needsSpecular{ SHADING_MODE == ShadingMode::Combined || SHADING_MODE == ShadingMode::Specular };
+		//Gloss is in the diffuse texture's alpha, specular intensity next to the normal
+		static constexpr bool needsUv{ needsDiffuse || needsSpecular || useNormalMap };
+	};
+	using RasterizeFunction = void (Rasterizer_Software::*)(const VertexStreams&);
+
+	//Wide shading: fragments that passed the depth test wait here and are shaded 8 at a time, one per SIMD lane.
+	//Every job that rasterizes or resolves pixels has its own batch, so lanes only ever hold that job's pixels
+	struct FragmentBatch
+	{
+		static constexpr int SIZE{ 8 };
+
+		alignas(32) int32_t triangleIdx[SIZE];
+		alignas(32) int32_t pixelIdx[SIZE];
+		alignas(32) float weight0[SIZE];
+		alignas(32) float weight1[SIZE];
+		alignas(32) float weight2[SIZE];
+		int count{};
+	};
+
+	enum class TraversalMode
+	{
+		BoundingBox, Scanline
+	};
+
+	enum class CullMode
+	{
+		Back, Front, None
+	};
+
+	//Planes of the clipper, in clip space
+	enum class ClipPlane
+	{
+		Near, Far, Left, Right, Bottom, Top
+	};
+	static constexpr int NR_CLIP_PLANES{ 6 };
+
+	//Why SetupTriangle dropped a triangle
+	enum class SetupResult
+	{
+		Visible, OutsideFrustum, Facing, Degenerate, SubPixel
+	};
+
+	//Triangle setup counters of one frame
+	struct SetupStats
+	{
+		uint32_t nrSubmitted{};
+		uint32_t nrOutsideFrustum{};
+		uint32_t nrClipped{};
+		uint32_t nrFacing{};
+		uint32_t nrDegenerate{};
+		uint32_t nrSubPixel{};
+	};
+
 	SDL_Window* m_pWindow{};
 
 	SDL_Surface* m_pFrontBuffer{ nullptr };
@@ -42,12 +186,19 @@ private:
 
 	float* m_pDepthBufferPixels{};
 
-	Mesh* m_pVehicleMesh;
+	//Deferred shading: per pixel the index (in m_Triangles) of the visible triangle and its barycentric weights
+	bool m_UseVisibilityBuffer{ false };
+	uint32_t* m_pTriangleIdBuffer{};
+	dae::Vector3* m_pWeightBuffer{};
 
-	Texture* m_pVehicleDiffuse;
-	Texture* m_pVehicleNormal;
-	Texture* m_pVehicleSpecular;
-	Texture* m_pVehicleGloss;
+	Mesh* m_pVehicleMesh{ nullptr };
+
+	//The vehicle's 4 maps prepared at load, so shading fetches at most 3 texels instead of 4: diffuse rgb,
+	//the tangent space normal's x and y (decoded and normalized, z is rebuilt) and specular rgb + gloss in alpha
+	Texture* m_pVehicleDiffuse{ nullptr };
+	Texture* m_pVehicleNormal{ nullptr };
+	Texture* m_pVehicleSpecularGloss{ nullptr };
+	Texture::TexelLayout m_TexelLayout{ Texture::TexelLayout::Tiled };
 
 	
 
@@ -57,18 +208,98 @@ private:
 
 	ShadingMode m_CurrentShadingMode{ ShadingMode::Combined };
 	ShadingMode m_ShadingMode{ ShadingMode::Combined };
-	bool m_ShadeDepth;
-	bool m_UseNormalMap;
-	bool m_UseBoundingBoxVisualization;
+	bool m_ShadeDepth{ false };
+	bool m_UseNormalMap{ true };
+	bool m_UseBoundingBoxVisualization{ false };
 
 	dae::Vector3 m_LightDirection{ .577f,-.577f,.577f };
 
+	bool m_UseBinning{ false };
+	bool m_UseSIMD{ true };
+	TraversalMode m_CurrentTraversalMode{ TraversalMode::BoundingBox };
+	CullMode m_CurrentCullMode{ CullMode::Back };
+	bool m_UseFixedPoint{ false };
+	bool m_IsMipmappingEnabled{ true };
+	Texture::FilterMode m_FilterMode{ Texture::FilterMode::Linear };
+	bool m_UseFastMath{ false };
+	//Lit pixels are shaded 8 at a time in structure of arrays form instead of one by one, the image is the same
+	bool m_UseWideShading{ true };
+	//Instruction set of the kernels, every level renders the same image
+	dae::SimdLevel m_SimdLevel{ dae::SimdLevel::SSE4 };
+	int m_NrThreads{ 1 };
+	//Vertices per job of the parallel vertex transform, 0 transforms them serially
+	int m_VertexChunkSize{ 4096 };
+	float m_VertexProcessingMs{};
+	//Triangle setup, rasterization and shading of the last frame
+	float m_RasterizationMs{};
+	ThreadPool* m_pThreadPool{ nullptr };
+
+	int m_NrTilesX{};
+	int m_NrTilesY{};
+	std::vector<std::vector<uint32_t>> m_TileBins{};
+
+	std::vector<TriangleSetup> m_Triangles{};
+	SetupStats m_SetupStats{};
+
+	//Hierarchical Z: farthest depth of every HIZ_BLOCK_SIZE x HIZ_BLOCK_SIZE block of the depth buffer.
+	//Writes only mark a block dirty, its depth is recomputed the next time a test needs it
+	bool m_UseHiZ{ true };
+	int m_NrHiZBlocksX{};
+	int m_NrHiZBlocksY{};
+	std::vector<float> m_HiZMaxDepth{};
+	std::vector<uint8_t> m_HiZDirty{};
+
+	//Per triangle: how many of its tiles HiZ rejected as a whole, the triangle is rejected once all of them are
+	std::vector<uint32_t> m_HiZRejectedTiles{};
+	std::atomic<uint32_t> m_HiZRejectedBlocks{};
+	uint32_t m_NrRasterizedTriangles{};
+	uint32_t m_NrHiZRejectedTriangles{};
+
 
-	void RenderTriangleList(const Mesh* currentMesh);
-	void RenderTriangleStrip(const Mesh* currentMesh);
-	void LoopOverPixels(const Vertex_Out& ver0, const Vertex_Out& ver1, const Vertex_Out& ver2);
+	void RenderTriangleList(Mesh* currentMesh);
+	void RenderTriangleStrip(Mesh* currentMesh);
+	void AddTriangle(Mesh* pMesh, uint32_t idx0, uint32_t idx1, uint32_t idx2);
+	static uint32_t GetClipCode(const dae::Vector4& clipPosition);
+	static float GetClipDistance(const dae::Vector4& clipPosition, ClipPlane plane);
+	void ClipTriangle(Mesh* pMesh, uint32_t idx0, uint32_t idx1, uint32_t idx2);
+	void SubmitTriangle(const std::vector<dae::Vector4>& positions, uint32_t idx0, uint32_t idx1, uint32_t idx2);
+	SetupResult SetupTriangle(const std::vector<dae::Vector4>& positions, uint32_t idx0, uint32_t idx1, uint32_t idx2, TriangleSetup& triangle) const;
+	SetupResult SetupTriangleFixed(const std::vector<dae::Vector4>& positions, uint32_t idx0, uint32_t idx1, uint32_t idx2, TriangleSetup& triangle) const;
+	//The instantiation of RasterizeTriangles for the current settings and m_SimdLevel
+	RasterizeFunction SelectPipeline() const;
+	//Built once per SIMD level with the kernels, together with every pipeline they return
+	template<dae::SimdLevel SIMD_LEVEL> RasterizeFunction SelectPipeline() const;
+	template<dae::SimdLevel SIMD_LEVEL, ShadingMode SHADING_MODE> RasterizeFunction SelectPipeline() const;
+	template<typename Pipeline> void RasterizeTriangles(const VertexStreams& vertices);
+	template<typename Pipeline> void RasterizeTrianglesSerial(const VertexStreams& vertices);
+	template<typename Pipeline> void RasterizeTrianglesBinned(const VertexStreams& vertices);
+	//rectMin - rectMax has to lie within one tile, the HiZ masks have a bit per block of a tile row
+	template<typename Pipeline> void LoopOverPixels(const TriangleSetup& triangle, const VertexStreams& vertices, const Int2& rectMin, const Int2& rectMax, FragmentBatch& batch);
+	void MarkHiZDirty(int px, int py);
+	void UpdateHiZBlock(int blockIdx);
+	//Bit (blockX - firstBlockX) is set for every block of the row the triangle is behind. At most 32 blocks, one tile row always fits
+	uint32_t GetOccludedBlocks(float minDepth, int blockY, int firstBlockX, int lastBlockX);
+	template<typename Pipeline> void RasterizeRow(const TriangleSetup& triangle, const VertexStreams& vertices, const dae::Vector3& rowEdges, int py, int firstGroupX, int minX, int maxX, uint32_t occludedGroups, FragmentBatch& batch);
+	template<typename Pipeline> void RasterizeGroup(const TriangleSetup& triangle, const VertexStreams& vertices, const dae::Vector3& groupEdges, int py, int groupX, int minX, int maxX, FragmentBatch& batch);
+	template<typename Pipeline> void RasterizeRowSIMD(const TriangleSetup& triangle, const VertexStreams& vertices, const dae::Vector3& rowEdges, int py, int firstGroupX, int minX, int maxX, uint32_t occludedGroups, FragmentBatch& batch);
+	template<typename Pipeline> void RasterizeRowFixed(const TriangleSetup& triangle, const VertexStreams& vertices, int py, int firstGroupX, int minX, int maxX, uint32_t occludedGroups, FragmentBatch& batch);
+	template<typename Pipeline> void RasterizeSpan(const TriangleSetup& triangle, const VertexStreams& vertices, int py, int minX, int maxX, int firstGroupX, uint32_t occludedGroups, FragmentBatch& batch);
+	template<typename Pipeline> void OutputFragment(const TriangleSetup& triangle, const VertexStreams& vertices, const dae::Vector3& weight, int px, int py, float currentDepth, FragmentBatch& batch);
+	template<typename Pipeline> void ResolveVisibility(const VertexStreams& vertices, const Int2& rectMin, const Int2& rectMax);
+	//Shades the fragment right away, or with wide shading adds it to batch and shades the batch once it is full
+	template<typename Pipeline> void QueueFragment(const TriangleSetup& triangle, const VertexStreams& vertices, const dae::Vector3& weight, int px, int py, float currentDepth, FragmentBatch& batch);
+	template<typename Pipeline> void ShadeFragment(const TriangleSetup& triangle, const VertexStreams& vertices, const dae::Vector3& weight, int px, int py, float currentDepth);
+	//Shades the fragments in batch (if any) and empties it. Same arithmetic per lane as ShadeFragment and PixelShading
+	template<typename Pipeline> void ShadeBatch(FragmentBatch& batch, const VertexStreams& vertices);
 
-	void PixelShading(const Vertex_Out& v);
+	template<typename Pipeline> void PixelShading(const Vertex_Out& v);
+	//The SIMD types are the kernel's own (see SIMD.h): Lanes holds the interpolated inputs of the 8 lanes, Vector3Lanes is a Vector3x8
+	template<typename Pipeline, typename Lanes> void PixelShading(const FragmentBatch& batch, const Lanes& v);
+	//MaxToOne, SDL_MapRGB and the back buffer write of a shaded batch
+	template<typename Vector3Lanes> void WriteBatch(const FragmentBatch& batch, const Vector3Lanes& color);
+	//With the current filter mode, from the full size level only when mipmapping is off
+	dae::Vector4 SampleTexture(const Texture* pTexture, const Vertex_Out& v) const;
+	template<typename Lanes> auto SampleTexture(const Texture* pTexture, const Lanes& v) const;
 
 
 
@@ -0,0 +1,1173 @@
+#pragma once
+//Everything from RasterizeTriangles down to WriteBatch, compiled once per SIMD level by the Kernels_*.cpp files
+#include "Rasterizer_Software.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include "Texture_Kernels.inl"
+#include "SIMD.h"
+#include <bit>
+
+using namespace dae;
+
+namespace
+{
+	//1 / sqrt(x): the SSE estimate (12 bits) refined with one Newton-Raphson step (about 22 bits)
+	float FastInverseSqrt(float x)
+	{
+		const float estimate{ _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x))) };
+		return estimate * (1.5f - .5f * x * estimate * estimate);
+	}
+
+	//log2 of a positive normal float: the exponent field plus a polynomial for the mantissa in [1, 2), off by at most 1.7e-5
+	float FastLog2(float x)
+	{
+		const uint32_t bits{ std::bit_cast<uint32_t>(x) };
+		const float exponent{ static_cast<float>(static_cast<int>(bits >> 23) - 127) };
+		const float m{ std::bit_cast<float>((bits & 0x007FFFFF) | 0x3F800000) - 1.f };
+		return exponent + (1.65146709e-05f + m * (1.44149241f + m * (-0.706486449f + m * (0.409470299f + m * (-0.187488605f + m * 0.0430049578f)))));
+	}
+
+	//2^x: the whole part goes in the exponent field, a polynomial gives 2^fraction with a relative error below 3.5e-6
+	float FastExp2(float x)
+	{
+		x = std::max(x, -126.f);
+		const float whole{ floorf(x) };
+		const float f{ x - whole };
+		const float mantissa{ 1.00000349f + f * (0.692972922f + f * (0.241604357f + f * (0.0517449978f + f * 0.0136703095f))) };
+		return std::bit_cast<float>(std::bit_cast<uint32_t>(mantissa) + (static_cast<uint32_t>(static_cast<int>(whole)) << 23));
+	}
+
+	//Same special cases as powf for the bases shading uses (0 to 1)
+	float FastPow(float base, float exponent)
+	{
+		if (!(base > 0.f))
+			return exponent == 0.f ? 1.f : 0.f;
+
+		return FastExp2(exponent * FastLog2(base));
+	}
+
+	template<bool USE_FAST_MATH>
+	Vector3 Normalized(const Vector3& v)
+	{
+		if constexpr (USE_FAST_MATH)
+			return v * FastInverseSqrt(v.SqrMagnitude());
+		else
+			return v.Normalized();
+	}
+
+	//8 lane versions of the above, the same operations in the same order so every lane matches the scalar result
+	Float8 FastInverseSqrt(const Float8& x)
+	{
+		const Float8 estimate{ Float8::InverseSqrtEstimate(x) };
+		return estimate * (Float8{ 1.5f } - Float8{ .5f } * x * estimate * estimate);
+	}
+
+	Float8 FastLog2(const Float8& x)
+	{
+		const Int8 bits{ Int8::FromBits(x) };
+		const Float8 exponent{ ((bits >> 23) - Int8{ 127 }).ToFloat() };
+		const Float8 m{ ((bits & Int8{ 0x007FFFFF }) | Int8{ 0x3F800000 }).AsFloatBits() - Float8{ 1.f } };
+		return exponent + (Float8{ 1.65146709e-05f } + m * (Float8{ 1.44149241f } + m * (Float8{ -0.706486449f } + m * (Float8{ 0.409470299f } + m * (Float8{ -0.187488605f } + m * Float8{ 0.0430049578f })))));
+	}
+
+	Float8 FastExp2(Float8 x)
+	{
+		x = Float8::Max(x, Float8{ -126.f });
+		const Float8 whole{ Float8::Floor(x) };
+		const Float8 f{ x - whole };
+		const Float8 mantissa{ Float8{ 1.00000349f } + f * (Float8{ 0.692972922f } + f * (Float8{ 0.241604357f } + f * (Float8{ 0.0517449978f } + f * Float8{ 0.0136703095f }))) };
+		return Float8::Ldexp(mantissa, whole);
+	}
+
+	Float8 FastPow(const Float8& base, const Float8& exponent)
+	{
+		const Float8 zero{ 0.f };
+		const Float8 special{ Float8::Select(exponent == zero, zero, Float8{ 1.f }) };
+		return Float8::Select(zero < base, special, FastExp2(exponent * FastLog2(base)));
+	}
+
+	template<bool USE_FAST_MATH>
+	Vector3x8 Normalized(const Vector3x8& v)
+	{
+		if constexpr (USE_FAST_MATH)
+			return v * FastInverseSqrt(Vector3x8::Dot(v, v));
+		else
+			return v.Normalized();
+	}
+
+	//Interpolated inputs of PixelShading for the 8 lanes of a batch
+	struct FragmentLanes
+	{
+		Vector2x8 Uv;
+		Vector2x8 UvDdx;
+		Vector2x8 UvDdy;
+		Vector3x8 Normal;
+		Vector3x8 Tangent;
+		Vector3x8 ViewDirection;
+	};
+}
+
+template<SimdLevel SIMD_LEVEL>
+Rasterizer_Software::RasterizeFunction Rasterizer_Software::SelectPipeline() const
+{
+	static_assert(SIMD_LEVEL == SIMD_TARGET, "Instantiated once per level, by the kernels of that level");
+
+	//The shading mode doesn't matter when only bounding boxes are drawn
+	if (m_UseBoundingBoxVisualization)
+		return &Rasterizer_Software::RasterizeTriangles<PixelPipeline<SIMD_LEVEL, ShadingMode::Combined, false, true>>;
+
+	switch (m_CurrentShadingMode)
+	{
+	case ShadingMode::Diffuse:
+		return SelectPipeline<SIMD_LEVEL, ShadingMode::Diffuse>();
+	case ShadingMode::ObservedArea:
+		return SelectPipeline<SIMD_LEVEL, ShadingMode::ObservedArea>();
+	case ShadingMode::Specular:
+		return SelectPipeline<SIMD_LEVEL, ShadingMode::Specular>();
+	case ShadingMode::DepthBuffer:
+		return &Rasterizer_Software::RasterizeTriangles<PixelPipeline<SIMD_LEVEL, ShadingMode::DepthBuffer, false, false>>;
+	default:
+		return SelectPipeline<SIMD_LEVEL, ShadingMode::Combined>();
+	}
+}
+
+template<SimdLevel SIMD_LEVEL, Rasterizer_Software::ShadingMode SHADING_MODE>
+Rasterizer_Software::RasterizeFunction Rasterizer_Software::SelectPipeline() const
+{
+	if (m_UseFastMath)
+	{
+		if (m_UseNormalMap)
+			return &Rasterizer_Software::RasterizeTriangles<PixelPipeline<SIMD_LEVEL, SHADING_MODE, true, false, true>>;
+
+		return &Rasterizer_Software::RasterizeTriangles<PixelPipeline<SIMD_LEVEL, SHADING_MODE, false, false, true>>;
+	}
+
+	if (m_UseNormalMap)
+		return &Rasterizer_Software::RasterizeTriangles<PixelPipeline<SIMD_LEVEL, SHADING_MODE, true, false>>;
+
+	return &Rasterizer_Software::RasterizeTriangles<PixelPipeline<SIMD_LEVEL, SHADING_MODE, false, false>>;
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeTriangles(const VertexStreams& vertices)
+{
+	m_HiZRejectedTiles.assign(m_Triangles.size(), 0);
+	m_HiZRejectedBlocks = 0;
+
+	if (m_UseBinning)
+	{
+		RasterizeTrianglesBinned<Pipeline>(vertices);
+	}
+	else
+	{
+		RasterizeTrianglesSerial<Pipeline>(vertices);
+	}
+
+	//Second pass of the deferred mode: every visible pixel is shaded exactly once, no matter how much overdraw there was
+	if (m_UseVisibilityBuffer)
+	{
+		const auto resolveTile = [&](int tileIdx)
+			{
+				const Int2 tileMin{ (tileIdx % m_NrTilesX) * TILE_SIZE, (tileIdx / m_NrTilesX) * TILE_SIZE };
+				const Int2 tileMax{ tileMin.x + TILE_SIZE - 1, tileMin.y + TILE_SIZE - 1 };
+				ResolveVisibility<Pipeline>(vertices, tileMin, tileMax);
+			};
+
+		if (m_UseBinning)
+		{
+			m_pThreadPool->ParallelFor(m_NrTilesX * m_NrTilesY, resolveTile);
+		}
+		else
+		{
+			for (int tileIdx = 0; tileIdx < m_NrTilesX * m_NrTilesY; ++tileIdx)
+			{
+				resolveTile(tileIdx);
+			}
+		}
+	}
+
+	//A triangle only counts as rejected when HiZ rejected it in every tile it touches
+	m_NrRasterizedTriangles = static_cast<uint32_t>(m_Triangles.size());
+	m_NrHiZRejectedTriangles = 0;
+	for (size_t triangleIdx = 0; triangleIdx < m_Triangles.size(); ++triangleIdx)
+	{
+		const TriangleSetup& triangle{ m_Triangles[triangleIdx] };
+		const int nrTiles{ (triangle.max.x / TILE_SIZE - triangle.min.x / TILE_SIZE + 1) * (triangle.max.y / TILE_SIZE - triangle.min.y / TILE_SIZE + 1) };
+		if (m_HiZRejectedTiles[triangleIdx] == static_cast<uint32_t>(nrTiles))
+		{
+			++m_NrHiZRejectedTriangles;
+		}
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeTrianglesSerial(const VertexStreams& vertices)
+{
+	//The serial path also walks a triangle tile by tile, the edge functions restart at every tile
+	//so each pixel gets exactly the same values as in the binned path
+	FragmentBatch batch{};
+	for (const TriangleSetup& triangle : m_Triangles)
+	{
+		for (int tileY = triangle.min.y / TILE_SIZE; tileY <= triangle.max.y / TILE_SIZE; ++tileY)
+		{
+			for (int tileX = triangle.min.x / TILE_SIZE; tileX <= triangle.max.x / TILE_SIZE; ++tileX)
+			{
+				const Int2 tileMin{ tileX * TILE_SIZE, tileY * TILE_SIZE };
+				const Int2 tileMax{ tileMin.x + TILE_SIZE - 1, tileMin.y + TILE_SIZE - 1 };
+
+				LoopOverPixels<Pipeline>(triangle, vertices, tileMin, tileMax, batch);
+			}
+		}
+	}
+	ShadeBatch<Pipeline>(batch, vertices);
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeTrianglesBinned(const VertexStreams& vertices)
+{
+	for (std::vector<uint32_t>& bin : m_TileBins)
+	{
+		bin.clear();
+	}
+
+	//Binning: every triangle goes in the bin of every tile its bounding box touches.
+	//Bins are filled in submission order, so each pixel still sees the triangles in the same order as the serial path
+	for (uint32_t triangleIdx = 0; triangleIdx < m_Triangles.size(); ++triangleIdx)
+	{
+		const TriangleSetup& triangle{ m_Triangles[triangleIdx] };
+		for (int tileY = triangle.min.y / TILE_SIZE; tileY <= triangle.max.y / TILE_SIZE; ++tileY)
+		{
+			for (int tileX = triangle.min.x / TILE_SIZE; tileX <= triangle.max.x / TILE_SIZE; ++tileX)
+			{
+				m_TileBins[tileX + tileY * m_NrTilesX].push_back(triangleIdx);
+			}
+		}
+	}
+
+	//Every tile owns its own pixels, so the workers never write to the same place in the back/depth buffer
+	m_pThreadPool->ParallelFor(static_cast<int>(m_TileBins.size()), [&](int tileIdx)
+		{
+			const Int2 tileMin{ (tileIdx % m_NrTilesX) * TILE_SIZE, (tileIdx / m_NrTilesX) * TILE_SIZE };
+			const Int2 tileMax{ tileMin.x + TILE_SIZE - 1, tileMin.y + TILE_SIZE - 1 };
+
+			FragmentBatch batch{};
+			for (const uint32_t triangleIdx : m_TileBins[tileIdx])
+			{
+				LoopOverPixels<Pipeline>(m_Triangles[triangleIdx], vertices, tileMin, tileMax, batch);
+			}
+			ShadeBatch<Pipeline>(batch, vertices);
+		});
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::LoopOverPixels(const TriangleSetup& triangle, const VertexStreams& vertices, const Int2& rectMin, const Int2& rectMax, FragmentBatch& batch)
+{
+	//Only the part of the bounding box inside the given rect (tile) is visited
+	const int minX{ std::max(rectMin.x, triangle.min.x) };
+	const int minY{ std::max(rectMin.y, triangle.min.y) };
+	const int maxX{ std::min(rectMax.x, triangle.max.x) };
+	const int maxY{ std::min(rectMax.y, triangle.max.y) };
+
+	if constexpr (Pipeline::showBoundingBox)
+	{
+		ColorRGB finalColor{ 1.f,1.f,1.f };
+		//Update Color in Buffer
+		finalColor.MaxToOne();
+
+		const uint32_t color{ SDL_MapRGB(m_pBackBuffer->format,
+			static_cast<uint8_t>(finalColor.r * 255),
+			static_cast<uint8_t>(finalColor.g * 255),
+			static_cast<uint8_t>(finalColor.b * 255)) };
+
+		for (int py{ minY }; py <= maxY; ++py)
+		{
+			std::fill_n(m_pBackBufferPixels + minX + py * m_Width, maxX - minX + 1, color);
+		}
+		return;
+	}
+
+	//Pixels are handled in groups of PIXEL_GROUP_SIZE columns that start at a multiple of PIXEL_GROUP_SIZE (a tile always holds whole groups)
+	const int firstGroupX{ minX - minX % PIXEL_GROUP_SIZE };
+	const int firstBlockX{ firstGroupX / HIZ_BLOCK_SIZE };
+	const int lastBlockX{ maxX / HIZ_BLOCK_SIZE };
+
+	//HiZ: when every block the rect touches is already closer than the triangle, nothing of it in this rect can pass the depth test
+	if (m_UseHiZ)
+	{
+		const uint32_t allBlocks{ (1u << (lastBlockX - firstBlockX + 1)) - 1 };
+		bool isOccluded{ true };
+		for (int blockY{ minY / HIZ_BLOCK_SIZE }; isOccluded && blockY <= maxY / HIZ_BLOCK_SIZE; ++blockY)
+		{
+			isOccluded = GetOccludedBlocks(triangle.minDepth, blockY, firstBlockX, lastBlockX) == allBlocks;
+		}
+
+		if (isOccluded)
+		{
+			std::atomic_ref<uint32_t>{ m_HiZRejectedTiles[&triangle - m_Triangles.data()] }.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	//One bit per group of the row, set when HiZ rejected its block. Refreshed every time the rows enter a new block row.
+	//Rejected groups are skipped but the edge values still step over them, so the pixels that are drawn get the same values as without HiZ
+	uint32_t occludedGroups{};
+	uint32_t nrOccludedBlocks{};
+
+	//Row by row, so the depth and back buffer are walked in memory order.
+	//Edge values are evaluated once at the first group and then only stepped: +B per row, +A * PIXEL_GROUP_SIZE per group.
+	//The scalar and SIMD paths step in exactly the same way, so they produce the same image
+	Vector3 rowEdges{ triangle.edgeA * static_cast<float>(firstGroupX) + triangle.edgeB * static_cast<float>(minY) + triangle.edgeC };
+
+	for (int py{ minY }; py <= maxY; ++py)
+	{
+		if (m_UseHiZ && (py == minY || py % HIZ_BLOCK_SIZE == 0))
+		{
+			occludedGroups = GetOccludedBlocks(triangle.minDepth, py / HIZ_BLOCK_SIZE, firstBlockX, lastBlockX);
+			nrOccludedBlocks += std::popcount(occludedGroups);
+		}
+
+		if (m_UseFixedPoint)
+		{
+			RasterizeRowFixed<Pipeline>(triangle, vertices, py, firstGroupX, minX, maxX, occludedGroups, batch);
+		}
+		else if (m_CurrentTraversalMode == TraversalMode::Scanline)
+		{
+			RasterizeSpan<Pipeline>(triangle, vertices, py, minX, maxX, firstGroupX, occludedGroups, batch);
+		}
+		else if (m_UseSIMD)
+		{
+			RasterizeRowSIMD<Pipeline>(triangle, vertices, rowEdges, py, firstGroupX, minX, maxX, occludedGroups, batch);
+		}
+		else
+		{
+			RasterizeRow<Pipeline>(triangle, vertices, rowEdges, py, firstGroupX, minX, maxX, occludedGroups, batch);
+		}
+
+		rowEdges += triangle.edgeB;
+	}
+
+	if (nrOccludedBlocks != 0)
+	{
+		m_HiZRejectedBlocks.fetch_add(nrOccludedBlocks, std::memory_order_relaxed);
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeRow(const TriangleSetup& triangle, const VertexStreams& vertices, const Vector3& rowEdges, int py, int firstGroupX, int minX, int maxX, uint32_t occludedGroups, FragmentBatch& batch)
+{
+	const Vector3 groupStep{ triangle.edgeA * static_cast<float>(PIXEL_GROUP_SIZE) };
+	Vector3 groupEdges{ rowEdges };
+
+	for (int groupX{ firstGroupX }; groupX <= maxX; groupX += PIXEL_GROUP_SIZE, groupEdges += groupStep, occludedGroups >>= 1)
+	{
+		if (occludedGroups & 1)
+			continue;
+
+		RasterizeGroup<Pipeline>(triangle, vertices, groupEdges, py, groupX, minX, maxX, batch);
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeGroup(const TriangleSetup& triangle, const VertexStreams& vertices, const Vector3& groupEdges, int py, int groupX, int minX, int maxX, FragmentBatch& batch)
+{
+	for (int lane{ 0 }; lane < PIXEL_GROUP_SIZE; ++lane)
+	{
+		const int px{ groupX + lane };
+		if (px < minX || px > maxX)
+			continue;
+
+		const Vector3 edges{ groupEdges + triangle.edgeA * static_cast<float>(lane) };
+
+		//Left handed --> clockwise is negative, outside as soon as one edge is positive
+		if (edges.x <= 0.f && edges.y <= 0.f && edges.z <= 0.f)
+		{
+			const Vector3 weight{ edges * triangle.invArea };
+
+			//Z interpolated non-linear. On thin triangles the weights don't sum up to exactly 1, which can put the depth in front of every vertex,
+			//clamping keeps it inside the triangle so HiZ can trust minDepth
+			const float currentDepth{ std::max(1.f / (weight.x / triangle.depth.x + weight.y / triangle.depth.y + weight.z / triangle.depth.z), triangle.minDepth) };
+
+			if (currentDepth < m_pDepthBufferPixels[px + (py * m_Width)])
+			{
+				m_pDepthBufferPixels[px + (py * m_Width)] = currentDepth;
+				MarkHiZDirty(px, py);
+
+				OutputFragment<Pipeline>(triangle, vertices, weight, px, py, currentDepth, batch);
+			}
+		}
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeRowSIMD(const TriangleSetup& triangle, const VertexStreams& vertices, const Vector3& rowEdges, int py, int firstGroupX, int minX, int maxX, uint32_t occludedGroups, FragmentBatch& batch)
+{
+	//One lane per column of a group, same arithmetic as RasterizeRow/RasterizeGroup
+	const Float8 lanes{ Float8::LaneIndices() };
+	const Float8 laneStep0{ Float8{ triangle.edgeA.x } * lanes };
+	const Float8 laneStep1{ Float8{ triangle.edgeA.y } * lanes };
+	const Float8 laneStep2{ Float8{ triangle.edgeA.z } * lanes };
+
+	const Float8 invArea{ triangle.invArea };
+	const Float8 z0{ triangle.depth.x };
+	const Float8 z1{ triangle.depth.y };
+	const Float8 z2{ triangle.depth.z };
+	const Float8 minDepth{ triangle.minDepth };
+	const Float8 zero{ 0.f };
+	const Float8 one{ 1.f };
+	const Float8 firstColumn{ static_cast<float>(minX) };
+	const Float8 lastColumn{ static_cast<float>(maxX) };
+
+	alignas(32) float weight0[PIXEL_GROUP_SIZE];
+	alignas(32) float weight1[PIXEL_GROUP_SIZE];
+	alignas(32) float weight2[PIXEL_GROUP_SIZE];
+	alignas(32) float depths[PIXEL_GROUP_SIZE];
+
+	const Vector3 groupStep{ triangle.edgeA * static_cast<float>(PIXEL_GROUP_SIZE) };
+	Vector3 groupEdges{ rowEdges };
+
+	for (int groupX{ firstGroupX }; groupX <= maxX; groupX += PIXEL_GROUP_SIZE, groupEdges += groupStep, occludedGroups >>= 1)
+	{
+		if (occludedGroups & 1)
+			continue;
+
+		//A group sticking out of the right side of the screen can't be loaded as a whole
+		if (groupX + PIXEL_GROUP_SIZE > m_Width)
+		{
+			RasterizeGroup<Pipeline>(triangle, vertices, groupEdges, py, groupX, minX, maxX, batch);
+			continue;
+		}
+
+		const Float8 edge0{ Float8{ groupEdges.x } + laneStep0 };
+		const Float8 edge1{ Float8{ groupEdges.y } + laneStep1 };
+		const Float8 edge2{ Float8{ groupEdges.z } + laneStep2 };
+
+		//Columns outside the bounding box (or outside the rect) never pass
+		const Float8 columns{ Float8{ static_cast<float>(groupX) } + lanes };
+		const Float8 coverage{ (firstColumn <= columns) & (columns <= lastColumn) & (edge0 <= zero) & (edge1 <= zero) & (edge2 <= zero) };
+
+		if (coverage.MoveMask() == 0)
+			continue;
+
+		const Float8 w0{ edge0 * invArea };
+		const Float8 w1{ edge1 * invArea };
+		const Float8 w2{ edge2 * invArea };
+
+		//Z interpolated non-linear, clamped like in RasterizeGroup
+		const Float8 currentDepth{ Float8::Max(one / (w0 / z0 + w1 / z1 + w2 / z2), minDepth) };
+
+		//Depth test and write on the covered lanes only
+		float* pDepth{ m_pDepthBufferPixels + groupX + py * m_Width };
+		const Float8 storedDepth{ Float8::Load(pDepth) };
+		const Float8 passed{ coverage & (currentDepth < storedDepth) };
+
+		int passedLanes{ passed.MoveMask() };
+		if (passedLanes == 0)
+			continue;
+
+		Float8::Select(passed, storedDepth, currentDepth).Store(pDepth);
+		MarkHiZDirty(groupX, py);
+
+		w0.Store(weight0);
+		w1.Store(weight1);
+		w2.Store(weight2);
+		currentDepth.Store(depths);
+
+		for (int lane{ 0 }; passedLanes != 0; ++lane, passedLanes >>= 1)
+		{
+			if (passedLanes & 1)
+			{
+				OutputFragment<Pipeline>(triangle, vertices, Vector3{ weight0[lane], weight1[lane], weight2[lane] }, groupX + lane, py, depths[lane], batch);
+			}
+		}
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeRowFixed(const TriangleSetup& triangle, const VertexStreams& vertices, int py, int firstGroupX, int minX, int maxX, uint32_t occludedGroups, FragmentBatch& batch)
+{
+	//Pixel samples sit on whole pixels of the sub-pixel grid. Integer stepping is exact, so the row start is evaluated directly
+	const int64_t sampleX{ static_cast<int64_t>(minX) << SUBPIXEL_BITS };
+	const int64_t sampleY{ static_cast<int64_t>(py) << SUBPIXEL_BITS };
+	int64_t edge0{ triangle.fixedEdgeA[0] * sampleX + triangle.fixedEdgeB[0] * sampleY + triangle.fixedEdgeC[0] };
+	int64_t edge1{ triangle.fixedEdgeA[1] * sampleX + triangle.fixedEdgeB[1] * sampleY + triangle.fixedEdgeC[1] };
+	int64_t edge2{ triangle.fixedEdgeA[2] * sampleX + triangle.fixedEdgeB[2] * sampleY + triangle.fixedEdgeC[2] };
+	const int64_t step0{ static_cast<int64_t>(triangle.fixedEdgeA[0]) << SUBPIXEL_BITS };
+	const int64_t step1{ static_cast<int64_t>(triangle.fixedEdgeA[1]) << SUBPIXEL_BITS };
+	const int64_t step2{ static_cast<int64_t>(triangle.fixedEdgeA[2]) << SUBPIXEL_BITS };
+
+	float* pDepth{ m_pDepthBufferPixels + py * m_Width };
+
+	for (int px{ minX }; px <= maxX; ++px, edge0 += step0, edge1 += step1, edge2 += step2)
+	{
+		//Inside when all three are negative, so when the sign bit survives the and
+		if ((edge0 & edge1 & edge2) >= 0)
+			continue;
+
+		if (occludedGroups & (1u << ((px - firstGroupX) / PIXEL_GROUP_SIZE)))
+			continue;
+
+		const Vector3 weight{ Vector3{ static_cast<float>(edge0), static_cast<float>(edge1), static_cast<float>(edge2) } * triangle.invArea };
+
+		//Z interpolated non-linear, clamped like in RasterizeGroup
+		const float currentDepth{ std::max(1.f / (weight.x / triangle.depth.x + weight.y / triangle.depth.y + weight.z / triangle.depth.z), triangle.minDepth) };
+
+		if (currentDepth < pDepth[px])
+		{
+			pDepth[px] = currentDepth;
+			MarkHiZDirty(px, py);
+
+			OutputFragment<Pipeline>(triangle, vertices, weight, px, py, currentDepth, batch);
+		}
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::RasterizeSpan(const TriangleSetup& triangle, const VertexStreams& vertices, int py, int minX, int maxX, int firstGroupX, uint32_t occludedGroups, FragmentBatch& batch)
+{
+	//On a row every edge function is a line in x: A * x + rowC <= 0 is a half line,
+	//the covered span is where the three half lines overlap
+	const Vector3 rowC{ triangle.edgeB * static_cast<float>(py) + triangle.edgeC };
+	float spanLeft{ static_cast<float>(minX) };
+	float spanRight{ static_cast<float>(maxX) };
+
+	for (int edge{ 0 }; edge < 3; ++edge)
+	{
+		const float a{ triangle.edgeA[edge] };
+		const float c{ rowC[edge] };
+
+		if (a > 0.f)
+		{
+			spanRight = std::min(spanRight, -c / a);
+		}
+		else if (a < 0.f)
+		{
+			spanLeft = std::max(spanLeft, -c / a);
+		}
+		else if (c > 0.f)
+		{
+			return;
+		}
+	}
+
+	if (spanLeft > spanRight)
+		return;
+
+	int left{ static_cast<int>(ceilf(spanLeft)) };
+	int right{ static_cast<int>(floorf(spanRight)) };
+
+	//The division can be off by a rounding error, nudge both ends so they agree with the edge test itself
+	const auto isCovered = [&](int px)
+		{
+			const Vector3 edges{ triangle.edgeA * static_cast<float>(px) + rowC };
+			return edges.x <= 0.f && edges.y <= 0.f && edges.z <= 0.f;
+		};
+	while (left <= right && !isCovered(left))
+		++left;
+	while (left > minX && isCovered(left - 1))
+		--left;
+	while (right >= left && !isCovered(right))
+		--right;
+	while (right < maxX && isCovered(right + 1))
+		++right;
+
+	Vector3 edges{ triangle.edgeA * static_cast<float>(left) + rowC };
+	float* pDepth{ m_pDepthBufferPixels + py * m_Width };
+
+	for (int px{ left }; px <= right; ++px, edges += triangle.edgeA)
+	{
+		if (occludedGroups & (1u << ((px - firstGroupX) / PIXEL_GROUP_SIZE)))
+			continue;
+
+		const Vector3 weight{ edges * triangle.invArea };
+
+		//Z interpolated non-linear, clamped like in RasterizeGroup
+		const float currentDepth{ std::max(1.f / (weight.x / triangle.depth.x + weight.y / triangle.depth.y + weight.z / triangle.depth.z), triangle.minDepth) };
+
+		if (currentDepth < pDepth[px])
+		{
+			pDepth[px] = currentDepth;
+			MarkHiZDirty(px, py);
+
+			OutputFragment<Pipeline>(triangle, vertices, weight, px, py, currentDepth, batch);
+		}
+	}
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::OutputFragment(const TriangleSetup& triangle, const VertexStreams& vertices, const Vector3& weight, int px, int py, float currentDepth, FragmentBatch& batch)
+{
+	//Deferred: only remember what is visible, ResolveVisibility shades it once rasterization is done
+	if (m_UseVisibilityBuffer)
+	{
+		const int pixelIdx{ px + py * m_Width };
+		m_pTriangleIdBuffer[pixelIdx] = static_cast<uint32_t>(&triangle - m_Triangles.data());
+		m_pWeightBuffer[pixelIdx] = weight;
+		return;
+	}
+
+	QueueFragment<Pipeline>(triangle, vertices, weight, px, py, currentDepth, batch);
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::ResolveVisibility(const VertexStreams& vertices, const Int2& rectMin, const Int2& rectMax)
+{
+	const int maxX{ std::min(rectMax.x, m_Width - 1) };
+	const int maxY{ std::min(rectMax.y, m_Height - 1) };
+
+	FragmentBatch batch{};
+	for (int py{ rectMin.y }; py <= maxY; ++py)
+	{
+		for (int px{ rectMin.x }; px <= maxX; ++px)
+		{
+			const int pixelIdx{ px + py * m_Width };
+			const uint32_t triangleIdx{ m_pTriangleIdBuffer[pixelIdx] };
+			if (triangleIdx == INVALID_TRIANGLE_ID)
+				continue;
+
+			const TriangleSetup& triangle{ m_Triangles[triangleIdx] };
+			QueueFragment<Pipeline>(triangle, vertices, m_pWeightBuffer[pixelIdx], px, py, m_pDepthBufferPixels[pixelIdx], batch);
+		}
+	}
+	ShadeBatch<Pipeline>(batch, vertices);
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::QueueFragment(const TriangleSetup& triangle, const VertexStreams& vertices, const Vector3& weight, int px, int py, float currentDepth, FragmentBatch& batch)
+{
+	//Depth visualization has nothing worth batching
+	if constexpr (Pipeline::isLit)
+	{
+		if (m_UseWideShading)
+		{
+			const int lane{ batch.count++ };
+			batch.triangleIdx[lane] = static_cast<int32_t>(&triangle - m_Triangles.data());
+			batch.pixelIdx[lane] = px + py * m_Width;
+			batch.weight0[lane] = weight.x;
+			batch.weight1[lane] = weight.y;
+			batch.weight2[lane] = weight.z;
+
+			if (batch.count == FragmentBatch::SIZE)
+			{
+				ShadeBatch<Pipeline>(batch, vertices);
+			}
+			return;
+		}
+	}
+
+	ShadeFragment<Pipeline>(triangle, vertices, weight, px, py, currentDepth);
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::ShadeFragment(const TriangleSetup& triangle, const VertexStreams& vertices, const Vector3& weight, int px, int py, float currentDepth)
+{
+	Vertex_Out currentPixel{};
+	currentPixel.Position = Vector4{ static_cast<float>(px), static_cast<float>(py), currentDepth, 0.f };
+
+	//Depth visualization only needs the depth the raster loop already has
+	if constexpr (Pipeline::isLit)
+	{
+		//Only the shading stage reads the varyings stream
+		const float w0{ vertices.positions[triangle.idx0].w };
+		const float w1{ vertices.positions[triangle.idx1].w };
+		const float w2{ vertices.positions[triangle.idx2].w };
+		const Vertex_Varyings& ver0{ vertices.varyings[triangle.idx0] };
+		const Vertex_Varyings& ver1{ vertices.varyings[triangle.idx1] };
+		const Vertex_Varyings& ver2{ vertices.varyings[triangle.idx2] };
+
+		if constexpr (Pipeline::useFastMath)
+		{
+			//Every 1 / w once, the varyings divided by w once
+			const float invW0{ 1.f / w0 };
+			const float invW1{ 1.f / w1 };
+			const float invW2{ 1.f / w2 };
+			const float wBuffer{ 1.f / (invW0 * weight.x + invW1 * weight.y + invW2 * weight.z) };
+			currentPixel.Position.w = wBuffer;
+
+			if constexpr (Pipeline::needsUv)
+			{
+				const Vector2 uv0{ ver0.Uv * invW0 };
+				const Vector2 uv1{ ver1.Uv * invW1 };
+				const Vector2 uv2{ ver2.Uv * invW2 };
+				const Vector2 uv{ (uv0 * weight.x + uv1 * weight.y + uv2 * weight.z) * wBuffer };
+				currentPixel.Uv = uv;
+
+				const Vector3& weightDdx{ triangle.weightDdx };
+				const Vector3& weightDdy{ triangle.weightDdy };
+				currentPixel.UvDdx = (uv0 * weightDdx.x + uv1 * weightDdx.y + uv2 * weightDdx.z - uv * (weightDdx.x * invW0 + weightDdx.y * invW1 + weightDdx.z * invW2)) * wBuffer;
+				currentPixel.UvDdy = (uv0 * weightDdy.x + uv1 * weightDdy.y + uv2 * weightDdy.z - uv * (weightDdy.x * invW0 + weightDdy.y * invW1 + weightDdy.z * invW2)) * wBuffer;
+			}
+
+			//The directions are normalized right away, so the common wBuffer factor is left out
+			const float vertexWeight0{ weight.x * w0 };
+			const float vertexWeight1{ weight.y * w1 };
+			const float vertexWeight2{ weight.z * w2 };
+			currentPixel.Normal = Normalized<true>(ver0.Normal * vertexWeight0 + ver1.Normal * vertexWeight1 + ver2.Normal * vertexWeight2);
+
+			if constexpr (Pipeline::useNormalMap)
+			{
+				currentPixel.Tangent = Normalized<true>(ver0.Tangent * vertexWeight0 + ver1.Tangent * vertexWeight1 + ver2.Tangent * vertexWeight2);
+			}
+
+			if constexpr (Pipeline::needsSpecular)
+			{
+				currentPixel.ViewDirection = Normalized<true>(ver0.ViewDirection * vertexWeight0 + ver1.ViewDirection * vertexWeight1 + ver2.ViewDirection * vertexWeight2);
+			}
+		}
+		else
+		{
+			//Z-interpolated, linear
+			const float wBuffer{ 1 / (1 / w0 * weight.x + 1 / w1 * weight.y + 1 / w2 * weight.z) };
+			currentPixel.Position.w = wBuffer;
+
+			if constexpr (Pipeline::needsUv)
+			{
+				const Vector2 uv{ (
+					ver0.Uv / w0 * weight.x +
+					ver1.Uv / w1 * weight.y +
+					ver2.Uv / w2 * weight.z) * wBuffer };
+				currentPixel.Uv = uv;
+
+				//uv = N / D with N = sum(weight * Uv / w) and D = sum(weight / w), so d(uv) = (dN - uv * dD) / D
+				const Vector3& weightDdx{ triangle.weightDdx };
+				const Vector3& weightDdy{ triangle.weightDdy };
+				currentPixel.UvDdx = (
+					ver0.Uv / w0 * weightDdx.x +
+					ver1.Uv / w1 * weightDdx.y +
+					ver2.Uv / w2 * weightDdx.z -
+					uv * (weightDdx.x / w0 + weightDdx.y / w1 + weightDdx.z / w2)) * wBuffer;
+				currentPixel.UvDdy = (
+					ver0.Uv / w0 * weightDdy.x +
+					ver1.Uv / w1 * weightDdy.y +
+					ver2.Uv / w2 * weightDdy.z -
+					uv * (weightDdy.x / w0 + weightDdy.y / w1 + weightDdy.z / w2)) * wBuffer;
+			}
+
+			currentPixel.Normal = (
+				ver0.Normal * weight.x * w0 +
+				ver1.Normal * weight.y * w1 +
+				ver2.Normal * weight.z * w2) * wBuffer;
+			currentPixel.Normal.Normalize();
+
+			if constexpr (Pipeline::useNormalMap)
+			{
+				currentPixel.Tangent = (
+					ver0.Tangent * weight.x * w0 +
+					ver1.Tangent * weight.y * w1 +
+					ver2.Tangent * weight.z * w2) * wBuffer;
+				currentPixel.Tangent.Normalize();
+			}
+
+			if constexpr (Pipeline::needsSpecular)
+			{
+				currentPixel.ViewDirection = (
+					ver0.ViewDirection * weight.x * w0 +
+					ver1.ViewDirection * weight.y * w1 +
+					ver2.ViewDirection * weight.z * w2) * wBuffer;
+				currentPixel.ViewDirection.Normalize();
+			}
+		}
+	}
+
+	PixelShading<Pipeline>(currentPixel);
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::ShadeBatch(FragmentBatch& batch, const VertexStreams& vertices)
+{
+	if (batch.count == 0)
+		return;
+
+	//Lanes past count repeat the last fragment, they are shaded but never written
+	for (int lane{ batch.count }; lane < FragmentBatch::SIZE; ++lane)
+	{
+		batch.triangleIdx[lane] = batch.triangleIdx[batch.count - 1];
+		batch.pixelIdx[lane] = batch.pixelIdx[batch.count - 1];
+		batch.weight0[lane] = batch.weight0[batch.count - 1];
+		batch.weight1[lane] = batch.weight1[batch.count - 1];
+		batch.weight2[lane] = batch.weight2[batch.count - 1];
+	}
+
+	//Per lane the triangle's vertices and weight derivatives
+	alignas(32) int32_t vertexIndices[3][FragmentBatch::SIZE];
+	alignas(32) float weightDdx[3][FragmentBatch::SIZE];
+	alignas(32) float weightDdy[3][FragmentBatch::SIZE];
+	for (int lane{ 0 }; lane < FragmentBatch::SIZE; ++lane)
+	{
+		const TriangleSetup& triangle{ m_Triangles[batch.triangleIdx[lane]] };
+		vertexIndices[0][lane] = static_cast<int32_t>(triangle.idx0);
+		vertexIndices[1][lane] = static_cast<int32_t>(triangle.idx1);
+		vertexIndices[2][lane] = static_cast<int32_t>(triangle.idx2);
+		weightDdx[0][lane] = triangle.weightDdx.x;
+		weightDdx[1][lane] = triangle.weightDdx.y;
+		weightDdx[2][lane] = triangle.weightDdx.z;
+		weightDdy[0][lane] = triangle.weightDdy.x;
+		weightDdy[1][lane] = triangle.weightDdy.y;
+		weightDdy[2][lane] = triangle.weightDdy.z;
+	}
+
+	//The vertex attributes are gathered straight out of the streams, indices count floats
+	static_assert(sizeof(Vector4) == 4 * sizeof(float) && sizeof(Vertex_Varyings) % sizeof(float) == 0);
+	const float* pPositions{ reinterpret_cast<const float*>(vertices.positions.data()) };
+	const float* pVaryings{ reinterpret_cast<const float*>(vertices.varyings.data()) };
+	const Int8 positionStride{ 4 };
+	const Int8 varyingStride{ static_cast<int32_t>(sizeof(Vertex_Varyings) / sizeof(float)) };
+
+	Int8 varyingIdx[3];
+	Float8 w[3];
+	for (int vertex{ 0 }; vertex < 3; ++vertex)
+	{
+		const Int8 vertexIdx{ Int8::Load(vertexIndices[vertex]) };
+		varyingIdx[vertex] = vertexIdx * varyingStride;
+		w[vertex] = Float8::Gather(pPositions + 3, vertexIdx * positionStride);
+	}
+	const auto gatherVarying = [&](int vertex, size_t memberOffset)
+		{
+			return Float8::Gather(pVaryings + memberOffset / sizeof(float), varyingIdx[vertex]);
+		};
+	const auto gatherVector3 = [&](int vertex, size_t memberOffset)
+		{
+			return Vector3x8{ gatherVarying(vertex, memberOffset), gatherVarying(vertex, memberOffset + sizeof(float)), gatherVarying(vertex, memberOffset + 2 * sizeof(float)) };
+		};
+
+	const Float8 weight[3]{ Float8::Load(batch.weight0), Float8::Load(batch.weight1), Float8::Load(batch.weight2) };
+	const Float8 ddx[3]{ Float8::Load(weightDdx[0]), Float8::Load(weightDdx[1]), Float8::Load(weightDdx[2]) };
+	const Float8 ddy[3]{ Float8::Load(weightDdy[0]), Float8::Load(weightDdy[1]), Float8::Load(weightDdy[2]) };
+	const Float8 one{ 1.f };
+
+	//Same as ShadeFragment, lane by lane
+	FragmentLanes fragments{};
+	if constexpr (Pipeline::useFastMath)
+	{
+		const Float8 invW[3]{ one / w[0], one / w[1], one / w[2] };
+		const Float8 wBuffer{ one / (invW[0] * weight[0] + invW[1] * weight[1] + invW[2] * weight[2]) };
+
+		if constexpr (Pipeline::needsUv)
+		{
+			Vector2x8 uvs[3];
+			for (int vertex{ 0 }; vertex < 3; ++vertex)
+			{
+				uvs[vertex] = Vector2x8{ gatherVarying(vertex, offsetof(Vertex_Varyings, Uv)) * invW[vertex], gatherVarying(vertex, offsetof(Vertex_Varyings, Uv) + sizeof(float)) * invW[vertex] };
+			}
+			fragments.Uv.x = (uvs[0].x * weight[0] + uvs[1].x * weight[1] + uvs[2].x * weight[2]) * wBuffer;
+			fragments.Uv.y = (uvs[0].y * weight[0] + uvs[1].y * weight[1] + uvs[2].y * weight[2]) * wBuffer;
+
+			const Float8 invWDdx{ ddx[0] * invW[0] + ddx[1] * invW[1] + ddx[2] * invW[2] };
+			const Float8 invWDdy{ ddy[0] * invW[0] + ddy[1] * invW[1] + ddy[2] * invW[2] };
+			fragments.UvDdx.x = (uvs[0].x * ddx[0] + uvs[1].x * ddx[1] + uvs[2].x * ddx[2] - fragments.Uv.x * invWDdx) * wBuffer;
+			fragments.UvDdx.y = (uvs[0].y * ddx[0] + uvs[1].y * ddx[1] + uvs[2].y * ddx[2] - fragments.Uv.y * invWDdx) * wBuffer;
+			fragments.UvDdy.x = (uvs[0].x * ddy[0] + uvs[1].x * ddy[1] + uvs[2].x * ddy[2] - fragments.Uv.x * invWDdy) * wBuffer;
+			fragments.UvDdy.y = (uvs[0].y * ddy[0] + uvs[1].y * ddy[1] + uvs[2].y * ddy[2] - fragments.Uv.y * invWDdy) * wBuffer;
+		}
+
+		const Float8 vertexWeight[3]{ weight[0] * w[0], weight[1] * w[1], weight[2] * w[2] };
+		const auto interpolate = [&](size_t memberOffset)
+			{
+				return Normalized<true>(gatherVector3(0, memberOffset) * vertexWeight[0] + gatherVector3(1, memberOffset) * vertexWeight[1] + gatherVector3(2, memberOffset) * vertexWeight[2]);
+			};
+		fragments.Normal = interpolate(offsetof(Vertex_Varyings, Normal));
+		if constexpr (Pipeline::useNormalMap)
+		{
+			fragments.Tangent = interpolate(offsetof(Vertex_Varyings, Tangent));
+		}
+		if constexpr (Pipeline::needsSpecular)
+		{
+			fragments.ViewDirection = interpolate(offsetof(Vertex_Varyings, ViewDirection));
+		}
+	}
+	else
+	{
+		const Float8 wBuffer{ one / (one / w[0] * weight[0] + one / w[1] * weight[1] + one / w[2] * weight[2]) };
+
+		if constexpr (Pipeline::needsUv)
+		{
+			Vector2x8 uvs[3];
+			for (int vertex{ 0 }; vertex < 3; ++vertex)
+			{
+				uvs[vertex] = Vector2x8{ gatherVarying(vertex, offsetof(Vertex_Varyings, Uv)) / w[vertex], gatherVarying(vertex, offsetof(Vertex_Varyings, Uv) + sizeof(float)) / w[vertex] };
+			}
+			fragments.Uv.x = (uvs[0].x * weight[0] + uvs[1].x * weight[1] + uvs[2].x * weight[2]) * wBuffer;
+			fragments.Uv.y = (uvs[0].y * weight[0] + uvs[1].y * weight[1] + uvs[2].y * weight[2]) * wBuffer;
+
+			const Float8 invWDdx{ ddx[0] / w[0] + ddx[1] / w[1] + ddx[2] / w[2] };
+			const Float8 invWDdy{ ddy[0] / w[0] + ddy[1] / w[1] + ddy[2] / w[2] };
+			fragments.UvDdx.x = (uvs[0].x * ddx[0] + uvs[1].x * ddx[1] + uvs[2].x * ddx[2] - fragments.Uv.x * invWDdx) * wBuffer;
+			fragments.UvDdx.y = (uvs[0].y * ddx[0] + uvs[1].y * ddx[1] + uvs[2].y * ddx[2] - fragments.Uv.y * invWDdx) * wBuffer;
+			fragments.UvDdy.x = (uvs[0].x * ddy[0] + uvs[1].x * ddy[1] + uvs[2].x * ddy[2] - fragments.Uv.x * invWDdy) * wBuffer;
+			fragments.UvDdy.y = (uvs[0].y * ddy[0] + uvs[1].y * ddy[1] + uvs[2].y * ddy[2] - fragments.Uv.y * invWDdy) * wBuffer;
+		}
+
+		const auto interpolate = [&](size_t memberOffset)
+			{
+				return ((gatherVector3(0, memberOffset) * weight[0] * w[0] + gatherVector3(1, memberOffset) * weight[1] * w[1] + gatherVector3(2, memberOffset) * weight[2] * w[2]) * wBuffer).Normalized();
+			};
+		fragments.Normal = interpolate(offsetof(Vertex_Varyings, Normal));
+		if constexpr (Pipeline::useNormalMap)
+		{
+			fragments.Tangent = interpolate(offsetof(Vertex_Varyings, Tangent));
+		}
+		if constexpr (Pipeline::needsSpecular)
+		{
+			fragments.ViewDirection = interpolate(offsetof(Vertex_Varyings, ViewDirection));
+		}
+	}
+
+	PixelShading<Pipeline>(batch, fragments);
+	batch.count = 0;
+}
+
+template<typename Lanes>
+auto Rasterizer_Software::SampleTexture(const Texture* pTexture, const Lanes& v) const
+{
+	return WideSampler<SIMD_TARGET>::SampleRGBA(*pTexture, v.Uv, v.UvDdx, v.UvDdy, m_FilterMode, m_IsMipmappingEnabled);
+}
+
+template<typename Pipeline>
+void Rasterizer_Software::PixelShading(const Vertex_Out& v)
+{
+	ColorRGB finalColor{};
+
+	if constexpr (!Pipeline::isLit)
+	{
+		const float remapped{ Remap(v.Position.z) };
+		finalColor = { remapped,remapped,remapped };
+	}
+	else
+	{
+		constexpr float intensity{ 7.f };
+		const float shininess{ 25.f };
+
+		Vector3 normal{ v.Normal };
+		if constexpr (Pipeline::useNormalMap)
+		{
+			//x, y: tangent space normal
+			const Vector4 normalSample{ SampleTexture(m_pVehicleNormal, v) };
+			const float x{ 2.f * normalSample.x - 1.f };
+			const float y{ 2.f * normalSample.y - 1.f };
+			const float z{ sqrtf(std::max(1.f - x * x - y * y, 0.f)) };
+
+			//Tangent space to world, the rows of the tangent space matrix written out
+			const Vector3 binormal{ Vector3::Cross(v.Normal, v.Tangent) };
+			normal = Normalized<Pipeline::useFastMath>(v.Tangent * x + binormal * y + v.Normal * z);
+		}
+
+		const float lambertCosine{ Vector3::Dot(normal, -m_LightDirection) };
+
+		if (lambertCosine > 0.f)
+		{
+			if constexpr (Pipeline::shadingMode == ShadingMode::ObservedArea)
+			{
+				finalColor = ColorRGB{ lambertCosine,lambertCosine,lambertCosine };
+			}
+			else
+			{
+				ColorRGB specular{};
+				if constexpr (Pipeline::needsSpecular)
+				{
+					//rgb: specular colour, w: gloss
+					const Vector4 specularGloss{ SampleTexture(m_pVehicleSpecularGloss, v) };
+
+					//Phong
+					Vector3 reflect = -m_LightDirection - 2 * std::max(Vector3::Dot(normal, -m_LightDirection), 0.f) * normal;
+					float alpha = std::max(Vector3::Dot(reflect, v.ViewDirection), 0.f);
+					float phong{};
+					if constexpr (Pipeline::useFastMath)
+					{
+						phong = FastPow(alpha, shininess * specularGloss.w);
+					}
+					else
+					{
+						phong = powf(alpha, shininess * specularGloss.w);
+					}
+					specular = ColorRGB{ specularGloss.x, specularGloss.y, specularGloss.z } * phong;
+				}
+
+				ColorRGB diffuse{};
+				if constexpr (Pipeline::needsDiffuse)
+				{
+					const Vector4 diffuseSample{ SampleTexture(m_pVehicleDiffuse, v) };
+					if constexpr (Pipeline::useFastMath)
+					{
+						//kd / PI folded into one multiply
+						constexpr float lambertScale{ intensity / PI };
+						diffuse = ColorRGB{ diffuseSample.x, diffuseSample.y, diffuseSample.z } * lambertScale;
+					}
+					else
+					{
+						diffuse = Utils::Lambert(intensity, ColorRGB{ diffuseSample.x, diffuseSample.y, diffuseSample.z });
+					}
+				}
+
+				if constexpr (Pipeline::shadingMode == ShadingMode::Combined)
+				{
+					const ColorRGB ambient{ .025f,.025f, .025f };
+					finalColor = (diffuse + specular + ambient) * lambertCosine;
+				}
+				else if constexpr (Pipeline::shadingMode == ShadingMode::Diffuse)
+				{
+					finalColor = diffuse * lambertCosine;
+				}
+				else
+				{
+					finalColor = specular * lambertCosine;
+				}
+			}
+		}
+	}
+
+	//Update Color in Buffer
+	finalColor.MaxToOne();
+
+	m_pBackBufferPixels[static_cast<int>(v.Position.x) + (static_cast<int>(v.Position.y) * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
+		static_cast<uint8_t>(finalColor.r * 255),
+		static_cast<uint8_t>(finalColor.g * 255),
+		static_cast<uint8_t>(finalColor.b * 255));
+}
+
+template<typename Pipeline, typename Lanes>
+void Rasterizer_Software::PixelShading(const FragmentBatch& batch, const Lanes& v)
+{
+	//The scalar PixelShading per lane. Lanes that aren't lit take part anyway and are set to black at the end
+	constexpr float intensity{ 7.f };
+	constexpr float shininess{ 25.f };
+	const Float8 zero{ 0.f };
+	const Float8 one{ 1.f };
+	const Vector3x8 toLight{ Float8{ -m_LightDirection.x }, Float8{ -m_LightDirection.y }, Float8{ -m_LightDirection.z } };
+
+	Vector3x8 normal{ v.Normal };
+	if constexpr (Pipeline::useNormalMap)
+	{
+		//x, y: tangent space normal
+		const Vector4x8 normalSample{ SampleTexture(m_pVehicleNormal, v) };
+		const Float8 two{ 2.f };
+		const Float8 x{ two * normalSample.x - one };
+		const Float8 y{ two * normalSample.y - one };
+		const Float8 z{ Float8::Sqrt(Float8::Max(one - x * x - y * y, zero)) };
+
+		const Vector3x8 binormal{ Vector3x8::Cross(v.Normal, v.Tangent) };
+		normal = Normalized<Pipeline::useFastMath>(v.Tangent * x + binormal * y + v.Normal * z);
+	}
+
+	const Float8 lambertCosine{ Vector3x8::Dot(normal, toLight) };
+	const Float8 isLit{ zero < lambertCosine };
+	if (isLit.MoveMask() == 0)
+	{
+		WriteBatch(batch, Vector3x8{ zero, zero, zero });
+		return;
+	}
+
+	Vector3x8 color{};
+	if constexpr (Pipeline::shadingMode == ShadingMode::ObservedArea)
+	{
+		color = Vector3x8{ lambertCosine, lambertCosine, lambertCosine };
+	}
+	else
+	{
+		Vector3x8 specular{};
+		if constexpr (Pipeline::needsSpecular)
+		{
+			//xyz: specular colour, w: gloss
+			const Vector4x8 specularGloss{ SampleTexture(m_pVehicleSpecularGloss, v) };
+
+			//Phong
+			const Float8 reflectScale{ Float8{ 2.f } * Float8::Max(Vector3x8::Dot(normal, toLight), zero) };
+			const Vector3x8 reflect{ toLight.x - normal.x * reflectScale, toLight.y - normal.y * reflectScale, toLight.z - normal.z * reflectScale };
+			const Float8 alpha{ Float8::Max(Vector3x8::Dot(reflect, v.ViewDirection), zero) };
+			const Float8 exponent{ Float8{ shininess } * specularGloss.w };
+			Float8 phong{};
+			if constexpr (Pipeline::useFastMath)
+			{
+				phong = FastPow(alpha, exponent);
+			}
+			else
+			{
+				//powf has no lane version that rounds the same, it runs per lane
+				alignas(32) float alphas[FragmentBatch::SIZE];
+				alignas(32) float exponents[FragmentBatch::SIZE];
+				alpha.Store(alphas);
+				exponent.Store(exponents);
+				for (int lane{ 0 }; lane < FragmentBatch::SIZE; ++lane)
+				{
+					alphas[lane] = powf(alphas[lane], exponents[lane]);
+				}
+				phong = Float8::Load(alphas);
+			}
+			specular = Vector3x8{ specularGloss.x, specularGloss.y, specularGloss.z } * phong;
+		}
+
+		Vector3x8 diffuse{};
+		if constexpr (Pipeline::needsDiffuse)
+		{
+			const Vector4x8 diffuseSample{ SampleTexture(m_pVehicleDiffuse, v) };
+			if constexpr (Pipeline::useFastMath)
+			{
+				const Float8 lambertScale{ intensity / PI };
+				diffuse = Vector3x8{ diffuseSample.x * lambertScale, diffuseSample.y * lambertScale, diffuseSample.z * lambertScale };
+			}
+			else
+			{
+				const Float8 kd{ intensity };
+				const Float8 pi{ PI };
+				diffuse = Vector3x8{ diffuseSample.x * kd / pi, diffuseSample.y * kd / pi, diffuseSample.z * kd / pi };
+			}
+		}
+
+		if constexpr (Pipeline::shadingMode == ShadingMode::Combined)
+		{
+			const Float8 ambient{ .025f };
+			color = Vector3x8{ diffuse.x + specular.x + ambient, diffuse.y + specular.y + ambient, diffuse.z + specular.z + ambient } * lambertCosine;
+		}
+		else if constexpr (Pipeline::shadingMode == ShadingMode::Diffuse)
+		{
+			color = diffuse * lambertCosine;
+		}
+		else
+		{
+			color = specular * lambertCosine;
+		}
+	}
+
+	WriteBatch(batch, Vector3x8{ Float8::Select(isLit, zero, color.x), Float8::Select(isLit, zero, color.y), Float8::Select(isLit, zero, color.z) });
+}
+
+template<typename Vector3Lanes>
+void Rasterizer_Software::WriteBatch(const FragmentBatch& batch, const Vector3Lanes& color)
+{
+	//MaxToOne
+	const Float8 maxValue{ Float8::Max(color.x, Float8::Max(color.y, color.z)) };
+	const Float8 isOverOne{ Float8{ 1.f } < maxValue };
+	const Float8 toByte{ 255.f };
+	const Int8 byteMask{ 0xFF };
+	const Int8 r{ Int8::Truncate(Float8::Select(isOverOne, color.x, color.x / maxValue) * toByte) & byteMask };
+	const Int8 g{ Int8::Truncate(Float8::Select(isOverOne, color.y, color.y / maxValue) * toByte) & byteMask };
+	const Int8 b{ Int8::Truncate(Float8::Select(isOverOne, color.z, color.z / maxValue) * toByte) & byteMask };
+
+	//SDL_MapRGB for every format without a palette
+	alignas(32) int32_t pixels[FragmentBatch::SIZE];
+	const SDL_PixelFormat* pFormat{ m_pBackBuffer->format };
+	if (pFormat->palette == nullptr)
+	{
+		const Int8 packed{ ((r >> pFormat->Rloss) << pFormat->Rshift) | ((g >> pFormat->Gloss) << pFormat->Gshift) | ((b >> pFormat->Bloss) << pFormat->Bshift)
+			| Int8{ static_cast<int32_t>(pFormat->Amask) } };
+		packed.Store(pixels);
+	}
+	else
+	{
+		alignas(32) int32_t channels[3][FragmentBatch::SIZE];
+		r.Store(channels[0]);
+		g.Store(channels[1]);
+		b.Store(channels[2]);
+		for (int lane{ 0 }; lane < batch.count; ++lane)
+		{
+			pixels[lane] = static_cast<int32_t>(SDL_MapRGB(pFormat, static_cast<uint8_t>(channels[0][lane]), static_cast<uint8_t>(channels[1][lane]), static_cast<uint8_t>(channels[2][lane])));
+		}
+	}
+
+	//In lane order, so a pixel that is in the batch twice ends up with the later fragment like without batching
+	for (int lane{ 0 }; lane < batch.count; ++lane)
+	{
+		m_pBackBufferPixels[batch.pixelIdx[lane]] = static_cast<uint32_t>(pixels[lane]);
+	}
+}
+
+//The only instantiation in this translation unit, every pipeline of its level comes with it
+template Rasterizer_Software::RasterizeFunction Rasterizer_Software::SelectPipeline<SIMD_TARGET>() const;
@@ -1,28 +1,68 @@
 #include "pch.h"
 #include "Renderer.h"
 #include "Utils.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
 #include "Rasterizer_Software.h"
 #include "Rasterizer_Hardware.h"
 
 namespace dae {
 
-	Renderer::Renderer(SDL_Window* pWindow) :
+	Renderer::Renderer(SDL_Window* pWindow, SimdLevel simdLevel) :
 		m_pWindow(pWindow)
 	{
 		//Initialize
 		SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	
-		//Parse obj
+		//Load the processed mesh from its cache, parse and process the obj when the cache is missing or out of date
 		std::vector<Vertex> vertices;
 		std::vector<uint32_t> indices;
+		Vector3 boundsMin{};
+		Vector3 boundsMax{};
 
-		Utils::ParseOBJ("Resources/vehicle.obj", vertices, indices);
+		//Part of the cache's key, so changing any of these rebuilds it
+		constexpr MeshCache::Settings meshSettings{ true, true, 1.05f };
+
+		const uint64_t loadStart{ SDL_GetPerformanceCounter() };
+		const bool isCached{ MeshCache::Load("Resources/vehicle.obj", meshSettings, vertices, indices, boundsMin, boundsMax) };
+		if (!isCached)
+		{
+			//A file that doesn't parse is neither processed nor cached, the next launch tries again
+			if (!Utils::ParseOBJ("Resources/vehicle.obj", vertices, indices, meshSettings.flipAxisAndWinding, meshSettings.weldVertices) || indices.empty())
+			{
+				std::cout << "Parsing vehicle.obj failed!\n";
+				return;
+			}
+			std::cout << "Parsed vehicle.obj: " << vertices.size() << " vertices (welded from " << indices.size() << " face corners, "
+				<< 100.f - 100.f * vertices.size() / std::max<size_t>(indices.size(), 1) << "% fewer)\n";
+
+			//Reorder the triangles once for both rasterizers
+			const float acmrBefore{ MeshOptimizer::AnalyzeVertexCache(indices, vertices.size()) };
+			const float overdrawBefore{ MeshOptimizer::AnalyzeOverdraw(vertices, indices) };
+			MeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+			MeshOptimizer::OptimizeOverdraw(vertices, indices, meshSettings.overdrawThreshold);
+			std::cout << "Optimized vehicle.obj: ACMR " << acmrBefore << " -> " << MeshOptimizer::AnalyzeVertexCache(indices, vertices.size())
+				<< ", overdraw " << overdrawBefore << " -> " << MeshOptimizer::AnalyzeOverdraw(vertices, indices) << '\n';
+
+			if (!MeshCache::Save("Resources/vehicle.obj", meshSettings, vertices, indices))
+			{
+				std::cout << "Writing the vehicle.obj mesh cache failed!\n";
+			}
+		}
+		const float loadMs{ static_cast<float>(SDL_GetPerformanceCounter() - loadStart) * 1000.f / static_cast<float>(SDL_GetPerformanceFrequency()) };
+		std::cout << "Loaded vehicle.obj: " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices in " << loadMs << " ms "
+			<< (isCached ? "(warm, from mesh cache)\n" : "(cold, parsed obj)\n");
+		if (isCached)
+		{
+			std::cout << "Bounds: (" << boundsMin.x << ", " << boundsMin.y << ", " << boundsMin.z << ") - (" << boundsMax.x << ", " << boundsMax.y << ", " << boundsMax.z << ")\n";
+		}
+		m_IsMeshLoaded = true;
 
 		//Initialize Camera
 		m_Camera.Initialize(static_cast<float>(m_Width) / m_Height, 45.f, { .0f,.0f,0.f });
 
 		//Initialize Software Rasterizer
-		m_pSoftwareRasterizer = new Rasterizer_Software(pWindow, m_Width, m_Height, &m_Camera);
+		m_pSoftwareRasterizer = new Rasterizer_Software(pWindow, m_Width, m_Height, &m_Camera, simdLevel);
 		const bool res = m_pSoftwareRasterizer->Initialize(vertices, indices);
 		if (res)
 		{
@@ -174,13 +214,24 @@ namespace dae {
 		}
 	}
 
+	void Renderer::PrintStats() const
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->PrintStats();
+		}
+	}
+
 	void Renderer::CycleSamplerFilter()
 	{
 		if (m_CurrentRenderMethod == RenderMethod::Hardware)
 		{
 			m_pHardwareRasterizer->CycleFilterMode();
 		}
-	
+		else
+		{
+			m_pSoftwareRasterizer->CycleFilterMode();
+		}
 	}
 
 	void Renderer::CycleShadingMode()
@@ -215,22 +266,146 @@ namespace dae {
 		}
 	}
 
+	void Renderer::CycleCullMode()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->CycleCullMode();
+		}
+	}
+
+	void Renderer::ToggleTiledRasterization()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleBinning();
+		}
+	}
+
+	void Renderer::CycleThreadCount()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->CycleThreadCount();
+		}
+	}
+
+	void Renderer::ToggleSIMDCoverage()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleSIMD();
+		}
+	}
+
+	void Renderer::CycleTraversalMode()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->CycleTraversalMode();
+		}
+	}
+
+	void Renderer::ToggleHiZCulling()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleHiZ();
+		}
+	}
+
+	void Renderer::ToggleVisibilityBufferShading()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleVisibilityBuffer();
+		}
+	}
+
+	void Renderer::ToggleFixedPointRasterization()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleFixedPoint();
+		}
+	}
+
+	void Renderer::CycleVertexChunkSize()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->CycleVertexChunkSize();
+		}
+	}
+
+	void Renderer::ToggleMipmapping()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleMipmapping();
+		}
+	}
+
+	void Renderer::BenchmarkTextureSampling()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->BenchmarkTextureSampling();
+		}
+	}
+
+	void Renderer::ToggleFastMath()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleFastMath();
+		}
+	}
+
+	void Renderer::ValidateFastMath()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ValidateFastMath();
+		}
+	}
+
+	void Renderer::ToggleWideShading()
+	{
+		if (m_CurrentRenderMethod == RenderMethod::Software)
+		{
+			m_pSoftwareRasterizer->ToggleWideShading();
+		}
+	}
+
 	void Renderer::PrintInfo()
 	{
 		std::cout << "[Key Bindings - SHARED]\n";
 		std::cout << "\t[F1]\tToggle Rasterizer Mode (HARDWARE/SOFTWARE)\n";
 		std::cout << "\t[F2]\tToggle Vehicle Rotation (ON/OFF)\n";
+		std::cout << "\t[F4]\tCycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n";
 		std::cout << "\t[F10]\tToggle Uniform ClearColor (ON/OFF)\n";
 		std::cout << "\t[F11]\tToggle Print FPS (ON/OFF)\n\n";
 
-		std::cout << "[Key Bindings - HARDWARE]\n";
-		std::cout << "\t[F4]\tCycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n\n";
-
 		std::cout << "[Key Bindings - SOFTWARE]\n";
 		std::cout << "\t[F5]\tCycle Shading Mode (COMBINED/OBSERVED_AREA/DIFFUSE/SPECULAR)\n";
 		std::cout << "\t[F6]\tToggle Normal Map (ON/OFF)\n";
 		std::cout << "\t[F7]\tToggle Depth Buffer Visualization (ON/OFF)\n";
 		std::cout << "\t[F8]\tToggle BoundingBox Visualization (ON/OFF)\n";
+		std::cout << "\t[F9]\tCycle Cull Mode (BACK/FRONT/NONE)\n";
+		std::cout << "\t[1]\tToggle Tiled Multithreaded Rasterization (ON/OFF)\n";
+		std::cout << "\t[2]\tCycle Worker Thread Count (1/2/4/.../64, HARDWARE THREADS)\n";
+		std::cout << "\t[3]\tToggle SIMD Coverage Test (ON/OFF)\n";
+		std::cout << "\t[4]\tCycle Traversal Mode (BOUNDING_BOX/SCANLINE)\n";
+		std::cout << "\t[5]\tToggle Hierarchical Z Culling (ON/OFF)\n";
+		std::cout << "\t[6]\tToggle Visibility Buffer (Deferred) Shading (ON/OFF)\n";
+		std::cout << "\t[7]\tToggle Fixed-Point Rasterization (ON/OFF)\n";
+		std::cout << "\t[8]\tCycle Vertex Chunk Size (OFF/1024/4096/16384/65536)\n";
+		std::cout << "\t[9]\tToggle Mipmapping (ON/OFF)\n";
+		std::cout << "\t[0]\tBenchmark Texture Sampling (every filter, LINEAR vs TILED texels, rotates the vehicle)\n";
+		std::cout << "\t[F]\tToggle Fast Math Shading (ON/OFF)\n";
+		std::cout << "\t[V]\tValidate Fast Math Shading (exact vs fast images, rotates the vehicle)\n";
+		std::cout << "\t[G]\tToggle 8-Wide SoA Shading (ON/OFF)\n";
 	}
 
 	
@@ -1,5 +1,6 @@
 #pragma once
 #include "Camera.h"
+#include "CpuFeatures.h"
 struct SDL_Window;
 struct SDL_Surface;
 class Rasterizer_Software;
@@ -10,7 +11,8 @@ namespace dae
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
+		//simdLevel: the instruction set of the software rasterizer's kernels
+		Renderer(SDL_Window* pWindow, SimdLevel simdLevel);
 		~Renderer();
 
 		Renderer(const Renderer&) = delete;
@@ -25,11 +27,29 @@ namespace dae
 		void ToggleUniformClearColor();
 		void ToggleRotation();
 		bool TogglePrintFPS();
+		void PrintStats() const;
 		void CycleSamplerFilter();
 		void CycleShadingMode();
 		void ToggleNormalMap();
 		void ToggleDepthBufferVisualisation();
 		void ToggleBoundingBoxVisualisation();
+		void CycleCullMode();
+		void ToggleTiledRasterization();
+		void CycleThreadCount();
+		void ToggleSIMDCoverage();
+		void CycleTraversalMode();
+		void ToggleHiZCulling();
+		void ToggleVisibilityBufferShading();
+		void ToggleFixedPointRasterization();
+		void CycleVertexChunkSize();
+		void ToggleMipmapping();
+		void BenchmarkTextureSampling();
+		void ToggleFastMath();
+		void ValidateFastMath();
+		void ToggleWideShading();
+
+		//False when the vehicle couldn't be loaded, nothing else is initialized then
+		bool IsMeshLoaded() const { return m_IsMeshLoaded; }
 
 	private:
 		enum class RenderMethod
@@ -42,6 +62,7 @@ namespace dae
 		int m_Width{};
 		int m_Height{};
 
+		bool m_IsMeshLoaded{ false };
 		bool m_IsDirectXInitialized{ false };
 		bool m_IsSoftwareInitialized{ false };
 		bool m_UseUniformColor{ false };
@@ -49,8 +70,8 @@ namespace dae
 		bool m_ShouldPrintFPS{ false };
 
 		Camera m_Camera{};
-		Rasterizer_Software* m_pSoftwareRasterizer;
-		Rasterizer_Hardware* m_pHardwareRasterizer;
+		Rasterizer_Software* m_pSoftwareRasterizer{ nullptr };
+		Rasterizer_Hardware* m_pHardwareRasterizer{ nullptr };
 
 		RenderMethod m_CurrentRenderMethod;
 		ColorRGB m_CurrentBGColor;
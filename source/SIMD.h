@@ -0,0 +1,286 @@
+#pragma once
+#include <immintrin.h>
+#include <cstdint>
+#include "CpuFeatures.h"
+
+//The types below are built for one SimdLevel, picked with SIMD_KERNEL_LEVEL. Only the kernels include this: they are compiled once per level,
+//each defining SIMD_KERNEL_LEVEL first (see Kernels_AVX2.cpp). Every level has its own namespace, so the kernels of two levels never share a function.
+//The kernels aren't compiled with /arch, intrinsics don't need it and /arch would also build the inline functions of every header they include
+//for that instruction set, which the linker could then pick for the code that runs on older CPUs
+#if !defined(SIMD_KERNEL_LEVEL)
+#error SIMD.h is only included by the kernels, which define SIMD_KERNEL_LEVEL first
+#endif
+
+#if SIMD_KERNEL_LEVEL == SIMD_LEVEL_AVX512
+#define SIMD_NAMESPACE avx512
+#elif SIMD_KERNEL_LEVEL == SIMD_LEVEL_AVX2
+#define SIMD_NAMESPACE avx2
+#else
+#define SIMD_NAMESPACE sse4
+#endif
+
+namespace dae
+{
+inline namespace SIMD_NAMESPACE
+{
+	//The level everything in this namespace is built for
+	constexpr SimdLevel SIMD_TARGET{ static_cast<SimdLevel>(SIMD_KERNEL_LEVEL) };
+
+	struct Int8;
+
+	//8 floats that are processed together.
+	//One 256 bit register from AVX2 on, two SSE registers for SSE4, results are the same on every level
+	struct Float8
+	{
+#if SIMD_KERNEL_LEVEL >= SIMD_LEVEL_AVX2
+		__m256 v;
+
+		Float8() = default;
+		Float8(__m256 _v) : v{ _v } {}
+		Float8(__m128 _lo, __m128 _hi) : v{ _mm256_set_m128(_hi, _lo) } {}
+		explicit Float8(float s) : v{ _mm256_set1_ps(s) } {}
+
+		//Lanes 0 to 3 and 4 to 7
+		__m128 Lo() const { return _mm256_castps256_ps128(v); }
+		__m128 Hi() const { return _mm256_extractf128_ps(v, 1); }
+
+		static Float8 Load(const float* p) { return _mm256_loadu_ps(p); }
+		void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+		//Lane i holds i
+		static Float8 LaneIndices() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+
+		Float8 operator+(const Float8& o) const { return _mm256_add_ps(v, o.v); }
+		Float8 operator-(const Float8& o) const { return _mm256_sub_ps(v, o.v); }
+		Float8 operator*(const Float8& o) const { return _mm256_mul_ps(v, o.v); }
+		Float8 operator/(const Float8& o) const { return _mm256_div_ps(v, o.v); }
+		Float8& operator+=(const Float8& o) { v = _mm256_add_ps(v, o.v); return *this; }
+
+		//Correctly rounded, same result as sqrtf per lane
+		static Float8 Sqrt(const Float8& a) { return _mm256_sqrt_ps(a.v); }
+		//12 bit estimate of 1 / sqrt, the same value _mm_rsqrt_ss gives per lane
+		static Float8 InverseSqrtEstimate(const Float8& a) { return _mm256_rsqrt_ps(a.v); }
+
+		//Comparisons return a mask: all bits set in the lanes where the comparison holds
+		Float8 operator<(const Float8& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LT_OQ); }
+		Float8 operator<=(const Float8& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LE_OQ); }
+		Float8 operator==(const Float8& o) const { return _mm256_cmp_ps(v, o.v, _CMP_EQ_OQ); }
+		Float8 operator&(const Float8& o) const { return _mm256_and_ps(v, o.v); }
+
+		//Picks b in the lanes where mask is set, a in the others
+		static Float8 Select(const Float8& mask, const Float8& a, const Float8& b)
+		{
+#if SIMD_KERNEL_LEVEL >= SIMD_LEVEL_AVX512
+			//Bitwise mask ? b : a, one instruction where blendv is two
+			return _mm256_castsi256_ps(_mm256_ternarylogic_epi32(_mm256_castps_si256(mask.v), _mm256_castps_si256(b.v), _mm256_castps_si256(a.v), 0xCA));
+#else
+			return _mm256_blendv_ps(a.v, b.v, mask.v);
+#endif
+		}
+
+		//Same result as std::max(a, b) in every lane, NaN in a included
+		static Float8 Max(const Float8& a, const Float8& b) { return _mm256_max_ps(b.v, a.v); }
+		//Rounded down like floorf
+		static Float8 Floor(const Float8& a) { return _mm256_floor_ps(a.v); }
+
+		//One bit per lane, lane 0 is the lowest bit
+		int MoveMask() const { return _mm256_movemask_ps(v); }
+#else
+		__m128 lo;
+		__m128 hi;
+
+		Float8() = default;
+		Float8(__m128 _lo, __m128 _hi) : lo{ _lo }, hi{ _hi } {}
+		explicit Float8(float s) : lo{ _mm_set1_ps(s) }, hi{ _mm_set1_ps(s) } {}
+
+		//Lanes 0 to 3 and 4 to 7
+		__m128 Lo() const { return lo; }
+		__m128 Hi() const { return hi; }
+
+		static Float8 Load(const float* p) { return { _mm_loadu_ps(p), _mm_loadu_ps(p + 4) }; }
+		void Store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+
+		//Lane i holds i
+		static Float8 LaneIndices() { return { _mm_setr_ps(0.f, 1.f, 2.f, 3.f), _mm_setr_ps(4.f, 5.f, 6.f, 7.f) }; }
+
+		Float8 operator+(const Float8& o) const { return { _mm_add_ps(lo, o.lo), _mm_add_ps(hi, o.hi) }; }
+		Float8 operator-(const Float8& o) const { return { _mm_sub_ps(lo, o.lo), _mm_sub_ps(hi, o.hi) }; }
+		Float8 operator*(const Float8& o) const { return { _mm_mul_ps(lo, o.lo), _mm_mul_ps(hi, o.hi) }; }
+		Float8 operator/(const Float8& o) const { return { _mm_div_ps(lo, o.lo), _mm_div_ps(hi, o.hi) }; }
+		Float8& operator+=(const Float8& o) { lo = _mm_add_ps(lo, o.lo); hi = _mm_add_ps(hi, o.hi); return *this; }
+
+		//Correctly rounded, same result as sqrtf per lane
+		static Float8 Sqrt(const Float8& a) { return { _mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi) }; }
+		//12 bit estimate of 1 / sqrt, the same value _mm_rsqrt_ss gives per lane
+		static Float8 InverseSqrtEstimate(const Float8& a) { return { _mm_rsqrt_ps(a.lo), _mm_rsqrt_ps(a.hi) }; }
+
+		//Comparisons return a mask: all bits set in the lanes where the comparison holds
+		Float8 operator<(const Float8& o) const { return { _mm_cmplt_ps(lo, o.lo), _mm_cmplt_ps(hi, o.hi) }; }
+		Float8 operator<=(const Float8& o) const { return { _mm_cmple_ps(lo, o.lo), _mm_cmple_ps(hi, o.hi) }; }
+		Float8 operator==(const Float8& o) const { return { _mm_cmpeq_ps(lo, o.lo), _mm_cmpeq_ps(hi, o.hi) }; }
+		Float8 operator&(const Float8& o) const { return { _mm_and_ps(lo, o.lo), _mm_and_ps(hi, o.hi) }; }
+
+		//Picks b in the lanes where mask is set, a in the others
+		static Float8 Select(const Float8& mask, const Float8& a, const Float8& b) { return { _mm_blendv_ps(a.lo, b.lo, mask.lo), _mm_blendv_ps(a.hi, b.hi, mask.hi) }; }
+
+		//Same result as std::max(a, b) in every lane, NaN in a included
+		static Float8 Max(const Float8& a, const Float8& b) { return { _mm_max_ps(b.lo, a.lo), _mm_max_ps(b.hi, a.hi) }; }
+		//Rounded down like floorf
+		static Float8 Floor(const Float8& a) { return { _mm_floor_ps(a.lo), _mm_floor_ps(a.hi) }; }
+
+		//One bit per lane, lane 0 is the lowest bit
+		int MoveMask() const { return _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4); }
+#endif
+
+		//p[indices[i]] in lane i
+		static Float8 Gather(const float* p, const Int8& indices);
+		//a * 2^exponent like ldexpf, for whole exponents that keep the result a normal float
+		static Float8 Ldexp(const Float8& a, const Float8& exponent);
+	};
+
+	//8 32 bit integers that are processed together, for indices and bit manipulation next to Float8.
+	//Registers like Float8, results are the same on every level
+	struct Int8
+	{
+#if SIMD_KERNEL_LEVEL >= SIMD_LEVEL_AVX2
+		__m256i v;
+
+		Int8() = default;
+		Int8(__m256i _v) : v{ _v } {}
+		explicit Int8(int32_t s) : v{ _mm256_set1_epi32(s) } {}
+
+		static Int8 Load(const int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+		void Store(int32_t* p) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+		Int8 operator+(const Int8& o) const { return _mm256_add_epi32(v, o.v); }
+		Int8 operator-(const Int8& o) const { return _mm256_sub_epi32(v, o.v); }
+		//Low 32 bits of the product, like int multiplication
+		Int8 operator*(const Int8& o) const { return _mm256_mullo_epi32(v, o.v); }
+		Int8 operator&(const Int8& o) const { return _mm256_and_si256(v, o.v); }
+		Int8 operator|(const Int8& o) const { return _mm256_or_si256(v, o.v); }
+		Int8 operator<<(int bits) const { return _mm256_slli_epi32(v, bits); }
+		//Shifts zeroes in, like uint32_t
+		Int8 operator>>(int bits) const { return _mm256_srli_epi32(v, bits); }
+
+		//Picks b in the lanes where mask is set, a in the others
+		static Int8 Select(const Int8& mask, const Int8& a, const Int8& b)
+		{
+#if SIMD_KERNEL_LEVEL >= SIMD_LEVEL_AVX512
+			return _mm256_ternarylogic_epi32(mask.v, b.v, a.v, 0xCA);
+#else
+			return _mm256_blendv_epi8(a.v, b.v, mask.v);
+#endif
+		}
+
+		//Rounded toward zero like static_cast<int>, out of range and NaN lanes become INT32_MIN
+		static Int8 Truncate(const Float8& a) { return _mm256_cvttps_epi32(a.v); }
+		Float8 ToFloat() const { return _mm256_cvtepi32_ps(v); }
+
+		//The same bits seen as the other type, this is how Float8 comparison masks become Int8 masks (-1 or 0)
+		static Int8 FromBits(const Float8& a) { return _mm256_castps_si256(a.v); }
+		Float8 AsFloatBits() const { return _mm256_castsi256_ps(v); }
+
+		//p[indices[i]] in lane i
+		static Int8 Gather(const int32_t* p, const Int8& indices) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(p), indices.v, 4); }
+#else
+		__m128i lo;
+		__m128i hi;
+
+		Int8() = default;
+		Int8(__m128i _lo, __m128i _hi) : lo{ _lo }, hi{ _hi } {}
+		explicit Int8(int32_t s) : lo{ _mm_set1_epi32(s) }, hi{ _mm_set1_epi32(s) } {}
+
+		static Int8 Load(const int32_t* p) { return { _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4)) }; }
+		void Store(int32_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), lo); _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 4), hi); }
+
+		Int8 operator+(const Int8& o) const { return { _mm_add_epi32(lo, o.lo), _mm_add_epi32(hi, o.hi) }; }
+		Int8 operator-(const Int8& o) const { return { _mm_sub_epi32(lo, o.lo), _mm_sub_epi32(hi, o.hi) }; }
+		//Low 32 bits of the product, like int multiplication
+		Int8 operator*(const Int8& o) const { return { _mm_mullo_epi32(lo, o.lo), _mm_mullo_epi32(hi, o.hi) }; }
+		Int8 operator&(const Int8& o) const { return { _mm_and_si128(lo, o.lo), _mm_and_si128(hi, o.hi) }; }
+		Int8 operator|(const Int8& o) const { return { _mm_or_si128(lo, o.lo), _mm_or_si128(hi, o.hi) }; }
+		Int8 operator<<(int bits) const { return { _mm_slli_epi32(lo, bits), _mm_slli_epi32(hi, bits) }; }
+		//Shifts zeroes in, like uint32_t
+		Int8 operator>>(int bits) const { return { _mm_srli_epi32(lo, bits), _mm_srli_epi32(hi, bits) }; }
+
+		//Picks b in the lanes where mask is set, a in the others
+		static Int8 Select(const Int8& mask, const Int8& a, const Int8& b) { return { _mm_blendv_epi8(a.lo, b.lo, mask.lo), _mm_blendv_epi8(a.hi, b.hi, mask.hi) }; }
+
+		//Rounded toward zero like static_cast<int>, out of range and NaN lanes become INT32_MIN
+		static Int8 Truncate(const Float8& a) { return { _mm_cvttps_epi32(a.Lo()), _mm_cvttps_epi32(a.Hi()) }; }
+		Float8 ToFloat() const { return { _mm_cvtepi32_ps(lo), _mm_cvtepi32_ps(hi) }; }
+
+		//The same bits seen as the other type, this is how Float8 comparison masks become Int8 masks (-1 or 0)
+		static Int8 FromBits(const Float8& a) { return { _mm_castps_si128(a.Lo()), _mm_castps_si128(a.Hi()) }; }
+		Float8 AsFloatBits() const { return { _mm_castsi128_ps(lo), _mm_castsi128_ps(hi) }; }
+
+		//p[indices[i]] in lane i, one load per lane
+		static Int8 Gather(const int32_t* p, const Int8& indices)
+		{
+			alignas(16) int32_t lanes[8];
+			indices.Store(lanes);
+			return { _mm_setr_epi32(p[lanes[0]], p[lanes[1]], p[lanes[2]], p[lanes[3]]), _mm_setr_epi32(p[lanes[4]], p[lanes[5]], p[lanes[6]], p[lanes[7]]) };
+		}
+#endif
+	};
+
+	inline Float8 Float8::Gather(const float* p, const Int8& indices)
+	{
+#if SIMD_KERNEL_LEVEL >= SIMD_LEVEL_AVX2
+		return _mm256_i32gather_ps(p, indices.v, 4);
+#else
+		alignas(16) int32_t lanes[8];
+		indices.Store(lanes);
+		return { _mm_setr_ps(p[lanes[0]], p[lanes[1]], p[lanes[2]], p[lanes[3]]), _mm_setr_ps(p[lanes[4]], p[lanes[5]], p[lanes[6]], p[lanes[7]]) };
+#endif
+	}
+
+	inline Float8 Float8::Ldexp(const Float8& a, const Float8& exponent)
+	{
+#if SIMD_KERNEL_LEVEL >= SIMD_LEVEL_AVX512
+		return _mm256_scalef_ps(a.v, exponent.v);
+#else
+		//Added straight to the exponent bits
+		return (Int8::FromBits(a) + (Int8::Truncate(exponent) << 23)).AsFloatBits();
+#endif
+	}
+
+	//Structure of arrays: 8 vectors, lane i of every component together is vector i
+	struct Vector2x8
+	{
+		Float8 x;
+		Float8 y;
+	};
+
+	//Same operations in the same order as dae::Vector3, so every lane gets exactly the scalar result
+	struct Vector3x8
+	{
+		Float8 x;
+		Float8 y;
+		Float8 z;
+
+		Vector3x8 operator+(const Vector3x8& o) const { return { x + o.x, y + o.y, z + o.z }; }
+		Vector3x8 operator*(const Float8& scale) const { return { x * scale, y * scale, z * scale }; }
+
+		Vector3x8 Normalized() const
+		{
+			const Float8 m{ Float8::Sqrt(Dot(*this, *this)) };
+			return { x / m, y / m, z / m };
+		}
+
+		static Float8 Dot(const Vector3x8& v1, const Vector3x8& v2) { return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z; }
+		static Vector3x8 Cross(const Vector3x8& v1, const Vector3x8& v2)
+		{
+			return { v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x };
+		}
+	};
+
+	struct Vector4x8
+	{
+		Float8 x;
+		Float8 y;
+		Float8 z;
+		Float8 w;
+	};
+}
+}
@@ -2,25 +2,37 @@
 #include "Texture.h"
 #include "Vector2.h"
 #include <SDL_image.h>
+#include <cstring>
+#include "ThreadPool.h"
 
 using namespace dae;
 
-Texture::Texture(SDL_Surface* pSurface) :
+Texture::Texture(SDL_Surface* pSurface, ThreadPool* pThreadPool, TexelLayout layout) :
 	m_pSurface{ pSurface },
 	m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
 {
+	//The surface is only kept when it can't be decoded
+	if (DecodeSurface(pSurface, pThreadPool))
+	{
+		SDL_FreeSurface(m_pSurface);
+		m_pSurface = nullptr;
+		m_pSurfacePixels = nullptr;
+
+		SetLayout(layout);
+	}
 }
 
 Texture::Texture(ID3D11Device* pDevice, const std::string& path)
 {
 	m_pSurface = IMG_Load(path.c_str());
 	m_pSurfacePixels = (uint32_t*)m_pSurface->pixels;
+	const bool isDecoded{ DecodeSurface(m_pSurface, nullptr) };
 
 	/**Texture*/
 	D3D11_TEXTURE2D_DESC desc{}; //Describes a 2d Texture
 	desc.Width = m_pSurface->w;
 	desc.Height = m_pSurface->h;
-	desc.MipLevels = 1; //How many Downsized version of texture
+	desc.MipLevels = isDecoded ? static_cast<UINT>(m_MipLevels.size()) : 1; //How many Downsized version of texture
 	desc.ArraySize = 1; //How many textures in texture array
 	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	desc.SampleDesc.Count = 1;
@@ -30,12 +42,25 @@ Texture::Texture(ID3D11Device* pDevice, const std::string& path)
 	desc.CPUAccessFlags = 0;
 	desc.MiscFlags = 0;
 
-	D3D11_SUBRESOURCE_DATA subResData{};
-	subResData.pSysMem = m_pSurface->pixels; //Pointer to init data
-	subResData.SysMemPitch = static_cast<UINT>(m_pSurface->pitch);  //Distance in bytes 
-	subResData.SysMemSlicePitch = static_cast<UINT>(m_pSurface->h * m_pSurface->pitch); //Doc says this is only for 3D textures, but whatever
+	//One per mip level, the surface as is when it couldn't be decoded
+	std::vector<D3D11_SUBRESOURCE_DATA> subResData(desc.MipLevels);
+	if (isDecoded)
+	{
+		for (size_t i = 0; i < m_MipLevels.size(); ++i)
+		{
+			subResData[i].pSysMem = m_MipLevels[i].pTexels;
+			subResData[i].SysMemPitch = static_cast<UINT>(m_MipLevels[i].width * sizeof(uint32_t));
+			subResData[i].SysMemSlicePitch = static_cast<UINT>(m_MipLevels[i].width * m_MipLevels[i].height * sizeof(uint32_t));
+		}
+	}
+	else
+	{
+		subResData[0].pSysMem = m_pSurface->pixels; //Pointer to init data
+		subResData[0].SysMemPitch = static_cast<UINT>(m_pSurface->pitch);  //Distance in bytes 
+		subResData[0].SysMemSlicePitch = static_cast<UINT>(m_pSurface->h * m_pSurface->pitch); //Doc says this is only for 3D textures, but whatever
+	}
 
-	HRESULT result{ pDevice->CreateTexture2D(&desc, &subResData, &m_pTexture) };
+	HRESULT result{ pDevice->CreateTexture2D(&desc, subResData.data(), &m_pTexture) };
 
 	if (FAILED(result))
 	{
@@ -46,7 +71,7 @@ Texture::Texture(ID3D11Device* pDevice, const std::string& path)
 	D3D11_SHADER_RESOURCE_VIEW_DESC rvDesc{};
 	rvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	rvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D; //Must be the same as resource type
-	rvDesc.Texture2D.MipLevels = 1;
+	rvDesc.Texture2D.MipLevels = desc.MipLevels;
 
 	result = pDevice->CreateShaderResourceView(m_pTexture, &rvDesc, &m_pResourceView);
 	if (FAILED(result))
@@ -59,10 +84,18 @@ Texture::Texture(ID3D11Device* pDevice, const std::string& path)
 		SDL_FreeSurface(m_pSurface);
 		m_pSurface = nullptr;
 	}
+
+	//The GPU has its own copy now
+	delete[] m_pTexelAllocation;
+	m_pTexelAllocation = nullptr;
+	m_pTexels = nullptr;
+	m_MipLevels.clear();
 }
 
 Texture::~Texture()
 {
+	delete[] m_pTexelAllocation;
+
 	if(m_pResourceView)
 		m_pResourceView->Release();
 
@@ -76,15 +109,99 @@ Texture::~Texture()
 	}
 }
 
-Texture* Texture::LoadFromFile(const std::string& path)
+Texture* Texture::LoadFromFile(const std::string& path, ThreadPool* pThreadPool, TexelLayout layout)
 {
 	SDL_Surface* surface = IMG_Load(path.c_str());
-	Texture* texture{ new Texture{surface} };
+	Texture* texture{ new Texture{surface, pThreadPool, layout} };
 
 	return texture;
 }
 
-ColorRGB Texture::Sample(const Vector2& uv) const
+Texture* Texture::CreatePacked(const Texture& first, const Texture& second, const std::function<uint32_t(uint32_t, uint32_t)>& pack, ThreadPool* pThreadPool, TexelLayout layout)
+{
+	if (first.m_pTexels == nullptr || second.m_pTexels == nullptr)
+		return nullptr;
+
+	const MipLevel& firstLevel{ first.m_MipLevels[0] };
+	const MipLevel& secondLevel{ second.m_MipLevels[0] };
+	if (firstLevel.width != secondLevel.width || firstLevel.height != secondLevel.height)
+		return nullptr;
+
+	Texture* pPacked{ new Texture{} };
+	pPacked->AllocateLevels(firstLevel.width, firstLevel.height);
+
+	uint32_t* pTexels{ pPacked->m_pTexels };
+	const auto packRow = [&](int y)
+		{
+			for (int x = 0; x < firstLevel.width; ++x)
+			{
+				pTexels[size_t(y) * firstLevel.width + x] = pack(firstLevel.pTexels[TexelIndex(firstLevel, x, y)], secondLevel.pTexels[TexelIndex(secondLevel, x, y)]);
+			}
+		};
+	if (pThreadPool != nullptr)
+	{
+		pThreadPool->ParallelFor(firstLevel.height, packRow);
+	}
+	else
+	{
+		for (int y = 0; y < firstLevel.height; ++y)
+		{
+			packRow(y);
+		}
+	}
+
+	pPacked->BuildMipChain(pThreadPool);
+	pPacked->SetLayout(layout);
+	return pPacked;
+}
+
+Texture* Texture::CreateConverted(const Texture& source, const std::function<uint32_t(uint32_t)>& convert, ThreadPool* pThreadPool, TexelLayout layout)
+{
+	return CreatePacked(source, source, [&convert](uint32_t texel, uint32_t) { return convert(texel); }, pThreadPool, layout);
+}
+
+size_t Texture::GetMemorySize() const
+{
+	if (m_pTexels == nullptr)
+		return m_pSurface != nullptr ? size_t(m_pSurface->h) * m_pSurface->pitch : 0;
+
+	const MipLevel& lastLevel{ m_MipLevels.back() };
+	return (lastLevel.pTexels + size_t(lastLevel.width) * lastLevel.height - m_pTexels) * sizeof(uint32_t);
+}
+
+void Texture::SetLayout(TexelLayout layout)
+{
+	if (m_pTexels == nullptr || layout == m_Layout)
+		return;
+
+	std::vector<uint32_t> levelCopy{};
+	for (MipLevel& level : m_MipLevels)
+	{
+		const bool isTiled{ layout == TexelLayout::Tiled && level.width % TILE_SIZE == 0 && level.height % TILE_SIZE == 0 };
+		if (isTiled == level.isTiled)
+			continue;
+
+		const MipLevel source{ level };
+		levelCopy.assign(source.pTexels, source.pTexels + size_t(source.width) * source.height);
+		level.isTiled = isTiled;
+
+		for (int y = 0; y < level.height; ++y)
+		{
+			for (int x = 0; x < level.width; ++x)
+			{
+				level.pTexels[TexelIndex(level, x, y)] = levelCopy[TexelIndex(source, x, y)];
+			}
+		}
+	}
+
+	for (size_t levelIdx = 0; levelIdx < m_MipLevels.size(); ++levelIdx)
+	{
+		m_LevelTable[levelIdx * LEVEL_TABLE_STRIDE + 3] = m_MipLevels[levelIdx].isTiled ? -1 : 0;
+	}
+	m_Layout = layout;
+}
+
+ColorRGB Texture::SampleSurface(const Vector2& uv) const
 {
 	const int nrColors{ 3 };
 	Uint8 rgb[nrColors];
@@ -95,4 +212,221 @@ ColorRGB Texture::Sample(const Vector2& uv) const
 
 
 	return ColorRGB{ static_cast<float>(rgb[0] / 255.0f),static_cast<float>(rgb[1] / 255.0f) ,static_cast<float>(rgb[2] / 255.0f) };
-}
\ No newline at end of file
+}
+
+Vector4 Texture::SampleRGBA(const Vector2& uv, const Vector2& ddx, const Vector2& ddy, FilterMode filter, bool useMipmaps) const
+{
+	if (m_pTexels == nullptr)
+	{
+		const ColorRGB color{ SampleSurface(uv) };
+		return Vector4{ color.r, color.g, color.b, 1.f };
+	}
+
+	//The pixel's footprint in full size texels, every level halves it
+	const MipLevel& baseLevel{ m_MipLevels[0] };
+	const Vector2 footprintX{ ddx.x * baseLevel.width, ddx.y * baseLevel.height };
+	const Vector2 footprintY{ ddy.x * baseLevel.width, ddy.y * baseLevel.height };
+	const float sqrLengthX{ footprintX.SqrMagnitude() };
+	const float sqrLengthY{ footprintY.SqrMagnitude() };
+
+	switch (filter)
+	{
+	case FilterMode::Point:
+	{
+		//Nearest level to the longer side, nearest texel in it
+		const float lod{ useMipmaps ? .5f * log2f(std::max(sqrLengthX, sqrLengthY)) : 0.f };
+		const int lastLevel{ static_cast<int>(m_MipLevels.size()) - 1 };
+		const int level{ lod > .5f ? std::min(static_cast<int>(lod + .5f), lastLevel) : 0 };
+		return ToVector4(SamplePoint(m_MipLevels[level], uv));
+	}
+	case FilterMode::Linear:
+		return ToVector4(SampleTrilinear(uv, useMipmaps ? .5f * log2f(std::max(sqrLengthX, sqrLengthY)) : 0.f));
+	case FilterMode::Anisotropic:
+	{
+		//Probes spread evenly along the long side, each one only has to cover a short side's worth of it,
+		//so the level comes from the long side divided by the number of probes instead of from the long side
+		const bool isXLonger{ sqrLengthX >= sqrLengthY };
+		const float majorLength{ sqrtf(isXLonger ? sqrLengthX : sqrLengthY) };
+		const float minorLength{ sqrtf(isXLonger ? sqrLengthY : sqrLengthX) };
+		const float ratio{ majorLength / minorLength };
+
+		//NaN (no footprint or NaN derivatives) takes a single probe
+		int nrProbes{ 1 };
+		if (ratio > 1.f)
+		{
+			nrProbes = ratio >= MAX_ANISOTROPY ? MAX_ANISOTROPY : static_cast<int>(ceilf(ratio));
+		}
+
+		const float lod{ useMipmaps ? log2f(majorLength / nrProbes) : 0.f };
+		if (nrProbes == 1)
+			return ToVector4(SampleTrilinear(uv, lod));
+
+		const Vector2& majorAxis{ isXLonger ? ddx : ddy };
+		__m128 sum{ _mm_setzero_ps() };
+		for (int probe = 0; probe < nrProbes; ++probe)
+		{
+			const float offset{ (probe + .5f) / nrProbes - .5f };
+			sum = _mm_add_ps(sum, SampleTrilinear(uv + majorAxis * offset, lod));
+		}
+		return ToVector4(_mm_mul_ps(sum, _mm_set1_ps(1.f / nrProbes)));
+	}
+	}
+
+	return ToVector4(SamplePoint(baseLevel, uv));
+}
+
+__m128 Texture::SampleTrilinear(const Vector2& uv, float lod) const
+{
+	//Magnified (or NaN derivatives)
+	if (!(lod > 0.f))
+		return SampleBilinear(m_MipLevels[0], uv);
+
+	const int lastLevel{ static_cast<int>(m_MipLevels.size()) - 1 };
+	if (lod >= lastLevel)
+		return SampleBilinear(m_MipLevels[lastLevel], uv);
+
+	const int level{ static_cast<int>(lod) };
+	const __m128 blend{ _mm_set1_ps(lod - level) };
+	const __m128 finer{ SampleBilinear(m_MipLevels[level], uv) };
+	const __m128 coarser{ SampleBilinear(m_MipLevels[level + 1], uv) };
+	return _mm_add_ps(finer, _mm_mul_ps(_mm_sub_ps(coarser, finer), blend));
+}
+
+__m128 Texture::SampleBilinear(const MipLevel& level, const Vector2& uv) const
+{
+	//Texel centers are at .5, so the 4 texels around the sample start half a texel to the top left
+	const float x{ uv.x * level.width - .5f };
+	const float y{ uv.y * level.height - .5f };
+	int x0{ static_cast<int>(x) };
+	int y0{ static_cast<int>(y) };
+	x0 -= x < static_cast<float>(x0);
+	y0 -= y < static_cast<float>(y0);
+	const __m128 blendX{ _mm_set1_ps(x - x0) };
+	const __m128 blendY{ _mm_set1_ps(y - y0) };
+
+	const int left{ WrapTexel(x0, level.width, level.wrapMaskX) };
+	const int right{ WrapTexel(x0 + 1, level.width, level.wrapMaskX) };
+	const int top{ WrapTexel(y0, level.height, level.wrapMaskY) };
+	const int bottom{ WrapTexel(y0 + 1, level.height, level.wrapMaskY) };
+	const __m128i texels{ _mm_setr_epi32(static_cast<int>(FetchTexel(level, left, top)), static_cast<int>(FetchTexel(level, right, top)),
+		static_cast<int>(FetchTexel(level, left, bottom)), static_cast<int>(FetchTexel(level, right, bottom))) };
+
+	//Bytes to 32 bit integers, one texel per register with its channels in the lanes. Dividing gives exactly s_ByteToFloat
+	const __m128i zero{ _mm_setzero_si128() };
+	const __m128i topWords{ _mm_unpacklo_epi8(texels, zero) };
+	const __m128i bottomWords{ _mm_unpackhi_epi8(texels, zero) };
+	const __m128 toUnit{ _mm_set1_ps(255.f) };
+	const __m128 topLeft{ _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(topWords, zero)), toUnit) };
+	const __m128 topRight{ _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(topWords, zero)), toUnit) };
+	const __m128 bottomLeft{ _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(bottomWords, zero)), toUnit) };
+	const __m128 bottomRight{ _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(bottomWords, zero)), toUnit) };
+
+	const __m128 topRow{ _mm_add_ps(topLeft, _mm_mul_ps(_mm_sub_ps(topRight, topLeft), blendX)) };
+	const __m128 bottomRow{ _mm_add_ps(bottomLeft, _mm_mul_ps(_mm_sub_ps(bottomRight, bottomLeft), blendX)) };
+	return _mm_add_ps(topRow, _mm_mul_ps(_mm_sub_ps(bottomRow, topRow), blendY));
+}
+
+ColorRGB Texture::ToColor(__m128 rgba)
+{
+	float channels[4];
+	_mm_storeu_ps(channels, rgba);
+	return ColorRGB{ channels[0], channels[1], channels[2] };
+}
+
+Vector4 Texture::ToVector4(__m128 rgba)
+{
+	float channels[4];
+	_mm_storeu_ps(channels, rgba);
+	return Vector4{ channels[0], channels[1], channels[2], channels[3] };
+}
+
+bool Texture::DecodeSurface(SDL_Surface* pSurface, ThreadPool* pThreadPool)
+{
+	//Let SDL resolve the format once
+	SDL_Surface* pRGBASurface{ SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+	if (pRGBASurface == nullptr)
+		return false;
+
+	AllocateLevels(pSurface->w, pSurface->h);
+
+	//The surface's rows can be padded
+	const MipLevel& baseLevel{ m_MipLevels[0] };
+	for (int y = 0; y < baseLevel.height; ++y)
+	{
+		memcpy(m_pTexels + size_t(y) * baseLevel.width, static_cast<const uint8_t*>(pRGBASurface->pixels) + size_t(y) * pRGBASurface->pitch, baseLevel.width * sizeof(uint32_t));
+	}
+	SDL_FreeSurface(pRGBASurface);
+
+	BuildMipChain(pThreadPool);
+	return true;
+}
+
+void Texture::AllocateLevels(int width, int height)
+{
+	//Levels down to 1x1, a side that reaches 1 first stays 1
+	size_t nrTexels{};
+	for (int levelWidth = width, levelHeight = height; ; levelWidth = std::max(levelWidth / 2, 1), levelHeight = std::max(levelHeight / 2, 1))
+	{
+		m_MipLevels.push_back(MipLevel{ nullptr, levelWidth, levelHeight, (levelWidth & (levelWidth - 1)) == 0 ? levelWidth - 1 : -1, (levelHeight & (levelHeight - 1)) == 0 ? levelHeight - 1 : -1, false });
+		nrTexels += size_t(levelWidth) * levelHeight;
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+	}
+
+	//Tiled levels hold a multiple of 16 texels, so aligning the start keeps every tile on its own cache line
+	const size_t cacheLineTexels{ 64 / sizeof(uint32_t) };
+	m_pTexelAllocation = new uint32_t[nrTexels + cacheLineTexels - 1];
+	const uintptr_t allocationAddress{ reinterpret_cast<uintptr_t>(m_pTexelAllocation) };
+	m_pTexels = reinterpret_cast<uint32_t*>((allocationAddress + 63) & ~uintptr_t{ 63 });
+
+	uint32_t* pLevelTexels{ m_pTexels };
+	for (MipLevel& level : m_MipLevels)
+	{
+		level.pTexels = pLevelTexels;
+		pLevelTexels += size_t(level.width) * level.height;
+
+		m_LevelTable.insert(m_LevelTable.end(), { static_cast<int32_t>(level.pTexels - m_pTexels), level.width, level.height, 0 });
+	}
+}
+
+void Texture::BuildMipChain(ThreadPool* pThreadPool)
+{
+	for (size_t i = 1; i < m_MipLevels.size(); ++i)
+	{
+		const MipLevel& source{ m_MipLevels[i - 1] };
+		const MipLevel& destination{ m_MipLevels[i] };
+		if (pThreadPool != nullptr)
+		{
+			pThreadPool->ParallelFor(destination.height, [&](int y) { DownsampleLevel(source, destination, y); });
+		}
+		else
+		{
+			for (int y = 0; y < destination.height; ++y)
+			{
+				DownsampleLevel(source, destination, y);
+			}
+		}
+	}
+}
+
+void Texture::DownsampleLevel(const MipLevel& source, const MipLevel& destination, int y) const
+{
+	//2x2 box filter, rounded. An odd last row or column is left out, a side of 1 is reused
+	const uint32_t* pTop{ source.pTexels + size_t(std::min(y * 2, source.height - 1)) * source.width };
+	const uint32_t* pBottom{ source.pTexels + size_t(std::min(y * 2 + 1, source.height - 1)) * source.width };
+	uint32_t* pDestination{ destination.pTexels + size_t(y) * destination.width };
+
+	for (int x = 0; x < destination.width; ++x)
+	{
+		const int left{ std::min(x * 2, source.width - 1) };
+		const int right{ std::min(x * 2 + 1, source.width - 1) };
+
+		uint32_t texel{};
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			const uint32_t sum{ ((pTop[left] >> shift) & 0xFF) + ((pTop[right] >> shift) & 0xFF) + ((pBottom[left] >> shift) & 0xFF) + ((pBottom[right] >> shift) & 0xFF) };
+			texel |= ((sum + 2) / 4) << shift;
+		}
+		pDestination[x] = texel;
+	}
+}
@@ -1,10 +1,28 @@
 #pragma once
 #include <SDL_surface.h>
 #include <string>
+#include <array>
+#include <functional>
+#include <immintrin.h>
+#include "CpuFeatures.h"
+
+class ThreadPool;
+//8 samples at once, built with the kernels of every SIMD level (Texture_Kernels.inl)
+template<dae::SimdLevel LEVEL> class WideSampler;
 
 class Texture final
 {
 public:
+	//How the texels of a mip level are ordered in memory.
+	//Tiled stores every 4x4 block as 16 consecutive texels (one 64 byte cache line), so a footprint that moves
+	//vertically or diagonally through the texture stays in the same lines instead of touching a new row every step.
+	//Levels with a side that isn't a multiple of 4 always stay linear
+	enum class TexelLayout
+	{
+		Linear,
+		Tiled
+	};
+
 	Texture(ID3D11Device* pDevice, const std::string& path);
 	~Texture();
 
@@ -13,17 +31,163 @@ public:
 	Texture& operator=(const Texture&) = delete;
 	Texture& operator=(Texture&&) noexcept = delete;
 
-	static Texture* LoadFromFile(const std::string& path);
-	dae::ColorRGB Sample(const dae::Vector2& uv) const;
+	//The mip chain is built on the thread pool when one is given
+	static Texture* LoadFromFile(const std::string& path, ThreadPool* pThreadPool = nullptr, TexelLayout layout = TexelLayout::Tiled);
+
+	//Same modes as the hardware sampler states
+	enum class FilterMode
+	{
+		Point,			//1 texel read per sample
+		Linear,			//Trilinear, 8 texel reads per sample (4 when magnified or without mipmaps)
+		Anisotropic		//Up to MAX_ANISOTROPY trilinear probes along the footprint's long axis, 8 texel reads each
+	};
+	static constexpr int MAX_ANISOTROPY{ 16 };
+
+	//A new texture whose full size level is pack(first texel, second texel) per texel, its mip chain is built from that.
+	//Both textures have to be decoded and the same size, nullptr otherwise
+	static Texture* CreatePacked(const Texture& first, const Texture& second, const std::function<uint32_t(uint32_t, uint32_t)>& pack,
+		ThreadPool* pThreadPool = nullptr, TexelLayout layout = TexelLayout::Tiled);
+	//Same for a single texture, convert(texel) per texel
+	static Texture* CreateConverted(const Texture& source, const std::function<uint32_t(uint32_t)>& convert,
+		ThreadPool* pThreadPool = nullptr, TexelLayout layout = TexelLayout::Tiled);
+
+	//Bytes held for software sampling: the decoded mip chain, or the surface when it couldn't be decoded
+	size_t GetMemorySize() const;
+
+	//Reorders the decoded texels, sampling gives the same result in both layouts
+	void SetLayout(TexelLayout layout);
+	TexelLayout GetLayout() const { return m_Layout; }
+
+	//Every texel address a sample reads is passed to recordAccess in order while it is set, nullptr stops recording.
+	//Only for measuring cache behaviour from a single thread
+	void SetAccessTrace(const std::function<void(uintptr_t)>& recordAccess) { m_RecordAccess = recordAccess; }
+
+	//Nearest texel of the full size level, uv wraps around. Reads the SDL surface when the texels couldn't be decoded at load
+	dae::ColorRGB Sample(const dae::Vector2& uv) const
+	{
+		if (m_pTexels == nullptr)
+			return SampleSurface(uv);
+
+		return ToColor(SamplePoint(m_MipLevels[0], uv));
+	}
+
+	//ddx and ddy are how much uv changes from one pixel to the next horizontally and vertically, they pick the mip level.
+	//Without mipmaps every mode reads the full size level only
+	dae::ColorRGB Sample(const dae::Vector2& uv, const dae::Vector2& ddx, const dae::Vector2& ddy, FilterMode filter = FilterMode::Linear, bool useMipmaps = true) const
+	{
+		const dae::Vector4 rgba{ SampleRGBA(uv, ddx, ddy, filter, useMipmaps) };
+		return dae::ColorRGB{ rgba.x, rgba.y, rgba.z };
+	}
+	//Same, with alpha in w. For packed textures that use all four channels
+	dae::Vector4 SampleRGBA(const dae::Vector2& uv, const dae::Vector2& ddx, const dae::Vector2& ddy, FilterMode filter = FilterMode::Linear, bool useMipmaps = true) const;
 
 	ID3D11ShaderResourceView* GetRV()const { return m_pResourceView; }
 
 private:
-	Texture(SDL_Surface* pSurface);
+	//Reads the levels directly
+	template<dae::SimdLevel LEVEL> friend class WideSampler;
 
-	ID3D11Texture2D* m_pTexture;
-	ID3D11ShaderResourceView* m_pResourceView; //Used to read a texture in shader
+	Texture() = default;
+	Texture(SDL_Surface* pSurface, ThreadPool* pThreadPool, TexelLayout layout);
+
+	//Same result as dividing by 255.f, without the division
+	static constexpr std::array<float, 256> s_ByteToFloat{ []()
+		{
+			std::array<float, 256> table{};
+			for (int i = 0; i < 256; ++i)
+			{
+				table[i] = i / 255.f;
+			}
+			return table;
+		}() };
+
+	ID3D11Texture2D* m_pTexture{ nullptr };
+	ID3D11ShaderResourceView* m_pResourceView{ nullptr }; //Used to read a texture in shader
 
 	SDL_Surface* m_pSurface{ nullptr };
 	uint32_t* m_pSurfacePixels{ nullptr };
+
+	struct MipLevel
+	{
+		uint32_t* pTexels;
+		int width;
+		int height;
+		//size - 1 for power of two sizes, -1 for sizes that need a modulo to wrap
+		int wrapMaskX;
+		int wrapMaskY;
+		bool isTiled;
+	};
+
+	//RGBA8, r in the lowest byte, decoded from the surface once so sampling doesn't depend on its format.
+	//Holds every mip level back to back, down to 1x1, each one a box filtered half of the one before.
+	//m_pTexels is m_pTexelAllocation aligned to a cache line, so every 4x4 tile fills exactly one line
+	uint32_t* m_pTexelAllocation{ nullptr };
+	uint32_t* m_pTexels{ nullptr };
+	std::vector<MipLevel> m_MipLevels;
+	TexelLayout m_Layout{ TexelLayout::Linear };
+
+	//Per level: first texel (from m_pTexels), width, height, -1 when tiled and 0 when linear. Gathered by WideSampler
+	static constexpr int LEVEL_TABLE_STRIDE{ 4 };
+	std::vector<int32_t> m_LevelTable;
+
+	std::function<void(uintptr_t)> m_RecordAccess{};
+
+	//False when SDL can't convert the surface, the texture then keeps sampling the surface
+	bool DecodeSurface(SDL_Surface* pSurface, ThreadPool* pThreadPool);
+	//Linear levels for a full size level of width x height, their texels aren't filled in
+	void AllocateLevels(int width, int height);
+	//Fills in every level after the full size one
+	void BuildMipChain(ThreadPool* pThreadPool);
+	void DownsampleLevel(const MipLevel& source, const MipLevel& destination, int y) const;
+
+	dae::ColorRGB SampleSurface(const dae::Vector2& uv) const;
+
+	//Samples stay in one register, rgba in lanes 0 to 3
+	__m128 SamplePoint(const MipLevel& level, const dae::Vector2& uv) const
+	{
+		const uint32_t texel{ FetchTexel(level, Wrap(uv.x, level.width, level.wrapMaskX), Wrap(uv.y, level.height, level.wrapMaskY)) };
+		return _mm_setr_ps(s_ByteToFloat[texel & 0xFF], s_ByteToFloat[(texel >> 8) & 0xFF], s_ByteToFloat[(texel >> 16) & 0xFF], s_ByteToFloat[texel >> 24]);
+	}
+	__m128 SampleBilinear(const MipLevel& level, const dae::Vector2& uv) const;
+	//Bilinear in the two levels around lod, blended. A lod of 0 or less (or NaN) is the full size level
+	__m128 SampleTrilinear(const dae::Vector2& uv, float lod) const;
+	static dae::ColorRGB ToColor(__m128 rgba);
+	static dae::Vector4 ToVector4(__m128 rgba);
+
+	static constexpr int TILE_SIZE{ 4 };
+	static constexpr int TILE_MASK{ TILE_SIZE - 1 };
+
+	//Offset of texel (x, y) in the level, x and y already wrapped
+	static size_t TexelIndex(const MipLevel& level, int x, int y)
+	{
+		if (!level.isTiled)
+			return size_t(y) * level.width + x;
+
+		//A row of tiles is TILE_SIZE texel rows, inside a tile the texels are in row order
+		return size_t(y & ~TILE_MASK) * level.width + size_t(x & ~TILE_MASK) * TILE_SIZE + (y & TILE_MASK) * TILE_SIZE + (x & TILE_MASK);
+	}
+
+	uint32_t FetchTexel(const MipLevel& level, int x, int y) const
+	{
+		const uint32_t* pTexel{ level.pTexels + TexelIndex(level, x, y) };
+		if (m_RecordAccess)
+		{
+			m_RecordAccess(reinterpret_cast<uintptr_t>(pTexel));
+		}
+		return *pTexel;
+	}
+
+	static int WrapTexel(int texel, int size, int wrapMask)
+	{
+		return wrapMask >= 0 ? texel & wrapMask : (texel % size + size) % size;
+	}
+
+	static int Wrap(float coordinate, int size, int wrapMask)
+	{
+		const float scaled{ coordinate * size };
+		int texel{ static_cast<int>(scaled) };
+		//Truncation rounds negative coordinates the wrong way
+		texel -= scaled < static_cast<float>(texel);
+		return WrapTexel(texel, size, wrapMask);
+	}
 };
\ No newline at end of file
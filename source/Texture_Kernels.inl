@@ -0,0 +1,218 @@
+#pragma once
+//The 8 lane texture sampler, compiled once per SIMD level by the Kernels_*.cpp files
+#include "Texture.h"
+#include "Vector2.h"
+#include "SIMD.h"
+
+using namespace dae;
+
+template<>
+class WideSampler<SIMD_TARGET> final
+{
+public:
+	//8 samples, one per lane, with exactly the result of Texture::SampleRGBA in every lane. Point and linear fetch their texels with gathers;
+	//anisotropic filtering, non power of two or undecoded textures and recorded accesses sample lane by lane
+	static Vector4x8 SampleRGBA(const Texture& texture, const Vector2x8& uv, const Vector2x8& ddx, const Vector2x8& ddy, Texture::FilterMode filter, bool useMipmaps);
+
+private:
+	//The mip level every lane reads
+	struct LevelLanes
+	{
+		Int8 firstTexel;
+		Int8 width;
+		Int8 height;
+		Int8 wrapMaskX;
+		Int8 wrapMaskY;
+		Int8 isTiled;
+	};
+	static LevelLanes GetLevelLanes(const Texture& texture, const int32_t* pLevels);
+	static Vector4x8 SamplePoint(const Texture& texture, const LevelLanes& levels, const Vector2x8& uv);
+	static Vector4x8 SampleBilinear(const Texture& texture, const LevelLanes& levels, const Vector2x8& uv);
+	static Vector4x8 SampleRGBAPerLane(const Texture& texture, const Vector2x8& uv, const Vector2x8& ddx, const Vector2x8& ddy, Texture::FilterMode filter, bool useMipmaps);
+	//Same as Texture::TexelIndex per lane, x and y already wrapped
+	static Int8 TexelIndex(const LevelLanes& levels, const Int8& x, const Int8& y);
+	//RGBA8 to 0 to 1 per channel, the same values as Texture::s_ByteToFloat
+	static Vector4x8 UnpackTexels(const Int8& texels);
+};
+
+Vector4x8 WideSampler<SIMD_TARGET>::SampleRGBA(const Texture& texture, const Vector2x8& uv, const Vector2x8& ddx, const Vector2x8& ddy, Texture::FilterMode filter, bool useMipmaps)
+{
+	if (texture.m_pTexels == nullptr || texture.m_RecordAccess || filter == Texture::FilterMode::Anisotropic)
+		return SampleRGBAPerLane(texture, uv, ddx, ddy, filter, useMipmaps);
+
+	//Lanes only wrap with a mask, every level of a power of two texture has one
+	const Texture::MipLevel& baseLevel{ texture.m_MipLevels[0] };
+	if (baseLevel.wrapMaskX < 0 || baseLevel.wrapMaskY < 0)
+		return SampleRGBAPerLane(texture, uv, ddx, ddy, filter, useMipmaps);
+
+	//Footprint as in the scalar SampleRGBA. The lod needs log2f to pick the same level, that part goes lane by lane
+	const Float8 baseWidth{ static_cast<float>(baseLevel.width) };
+	const Float8 baseHeight{ static_cast<float>(baseLevel.height) };
+	const Float8 footprintXu{ ddx.x * baseWidth };
+	const Float8 footprintXv{ ddx.y * baseHeight };
+	const Float8 footprintYu{ ddy.x * baseWidth };
+	const Float8 footprintYv{ ddy.y * baseHeight };
+	alignas(32) float sqrLengthsX[8];
+	alignas(32) float sqrLengthsY[8];
+	(footprintXu * footprintXu + footprintXv * footprintXv).Store(sqrLengthsX);
+	(footprintYu * footprintYu + footprintYv * footprintYv).Store(sqrLengthsY);
+
+	const int lastLevel{ static_cast<int>(texture.m_MipLevels.size()) - 1 };
+	alignas(32) int32_t finerLevels[8]{};
+	alignas(32) int32_t coarserLevels[8]{};
+	alignas(32) float blends[8]{};
+	bool isBlended{ false };
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		const float lod{ useMipmaps ? .5f * log2f(std::max(sqrLengthsX[lane], sqrLengthsY[lane])) : 0.f };
+		if (filter == Texture::FilterMode::Point)
+		{
+			finerLevels[lane] = lod > .5f ? std::min(static_cast<int>(lod + .5f), lastLevel) : 0;
+			continue;
+		}
+
+		//Same choice as SampleTrilinear. A lane that only reads one level reads it twice with a blend of 0, which leaves it unchanged
+		if (!(lod > 0.f))
+		{
+			finerLevels[lane] = 0;
+		}
+		else if (lod >= lastLevel)
+		{
+			finerLevels[lane] = lastLevel;
+		}
+		else
+		{
+			const int level{ static_cast<int>(lod) };
+			finerLevels[lane] = level;
+			coarserLevels[lane] = level + 1;
+			blends[lane] = lod - level;
+			isBlended = true;
+			continue;
+		}
+		coarserLevels[lane] = finerLevels[lane];
+	}
+
+	if (filter == Texture::FilterMode::Point)
+		return SamplePoint(texture, GetLevelLanes(texture, finerLevels), uv);
+
+	const Vector4x8 finer{ SampleBilinear(texture, GetLevelLanes(texture, finerLevels), uv) };
+	if (!isBlended)
+		return finer;
+
+	const Vector4x8 coarser{ SampleBilinear(texture, GetLevelLanes(texture, coarserLevels), uv) };
+	const Float8 blend{ Float8::Load(blends) };
+	return Vector4x8{
+		finer.x + (coarser.x - finer.x) * blend,
+		finer.y + (coarser.y - finer.y) * blend,
+		finer.z + (coarser.z - finer.z) * blend,
+		finer.w + (coarser.w - finer.w) * blend };
+}
+
+WideSampler<SIMD_TARGET>::LevelLanes WideSampler<SIMD_TARGET>::GetLevelLanes(const Texture& texture, const int32_t* pLevels)
+{
+	const Int8 tableIdx{ Int8::Load(pLevels) * Int8{ Texture::LEVEL_TABLE_STRIDE } };
+	const Int8 width{ Int8::Gather(texture.m_LevelTable.data() + 1, tableIdx) };
+	const Int8 height{ Int8::Gather(texture.m_LevelTable.data() + 2, tableIdx) };
+
+	//Only power of two textures are sampled in lanes, their masks are size - 1
+	const Int8 one{ 1 };
+	return LevelLanes{ Int8::Gather(texture.m_LevelTable.data(), tableIdx), width, height, width - one, height - one, Int8::Gather(texture.m_LevelTable.data() + 3, tableIdx) };
+}
+
+Vector4x8 WideSampler<SIMD_TARGET>::SamplePoint(const Texture& texture, const LevelLanes& levels, const Vector2x8& uv)
+{
+	//Wrap per lane: truncate, one down where that rounded up, then the mask (only power of two textures get here)
+	const Float8 scaledX{ uv.x * levels.width.ToFloat() };
+	const Float8 scaledY{ uv.y * levels.height.ToFloat() };
+	Int8 x{ Int8::Truncate(scaledX) };
+	Int8 y{ Int8::Truncate(scaledY) };
+	x = x + Int8::FromBits(scaledX < x.ToFloat());
+	y = y + Int8::FromBits(scaledY < y.ToFloat());
+
+	const int32_t* pTexels{ reinterpret_cast<const int32_t*>(texture.m_pTexels) };
+	return UnpackTexels(Int8::Gather(pTexels, TexelIndex(levels, x & levels.wrapMaskX, y & levels.wrapMaskY)));
+}
+
+Vector4x8 WideSampler<SIMD_TARGET>::SampleBilinear(const Texture& texture, const LevelLanes& levels, const Vector2x8& uv)
+{
+	//Same steps as the scalar SampleBilinear, the 4 texels of every lane are 4 gathers
+	const Float8 half{ .5f };
+	const Float8 x{ uv.x * levels.width.ToFloat() - half };
+	const Float8 y{ uv.y * levels.height.ToFloat() - half };
+	Int8 x0{ Int8::Truncate(x) };
+	Int8 y0{ Int8::Truncate(y) };
+	x0 = x0 + Int8::FromBits(x < x0.ToFloat());
+	y0 = y0 + Int8::FromBits(y < y0.ToFloat());
+	const Float8 blendX{ x - x0.ToFloat() };
+	const Float8 blendY{ y - y0.ToFloat() };
+
+	const Int8 one{ 1 };
+	const Int8 left{ x0 & levels.wrapMaskX };
+	const Int8 right{ (x0 + one) & levels.wrapMaskX };
+	const Int8 top{ y0 & levels.wrapMaskY };
+	const Int8 bottom{ (y0 + one) & levels.wrapMaskY };
+
+	const int32_t* pTexels{ reinterpret_cast<const int32_t*>(texture.m_pTexels) };
+	const Vector4x8 topLeft{ UnpackTexels(Int8::Gather(pTexels, TexelIndex(levels, left, top))) };
+	const Vector4x8 topRight{ UnpackTexels(Int8::Gather(pTexels, TexelIndex(levels, right, top))) };
+	const Vector4x8 bottomLeft{ UnpackTexels(Int8::Gather(pTexels, TexelIndex(levels, left, bottom))) };
+	const Vector4x8 bottomRight{ UnpackTexels(Int8::Gather(pTexels, TexelIndex(levels, right, bottom))) };
+
+	const auto blend = [&](const Float8& tl, const Float8& tr, const Float8& bl, const Float8& br)
+		{
+			const Float8 topRow{ tl + (tr - tl) * blendX };
+			const Float8 bottomRow{ bl + (br - bl) * blendX };
+			return topRow + (bottomRow - topRow) * blendY;
+		};
+	return Vector4x8{
+		blend(topLeft.x, topRight.x, bottomLeft.x, bottomRight.x),
+		blend(topLeft.y, topRight.y, bottomLeft.y, bottomRight.y),
+		blend(topLeft.z, topRight.z, bottomLeft.z, bottomRight.z),
+		blend(topLeft.w, topRight.w, bottomLeft.w, bottomRight.w) };
+}
+
+Vector4x8 WideSampler<SIMD_TARGET>::SampleRGBAPerLane(const Texture& texture, const Vector2x8& uv, const Vector2x8& ddx, const Vector2x8& ddy, Texture::FilterMode filter, bool useMipmaps)
+{
+	alignas(32) float inputs[6][8];
+	uv.x.Store(inputs[0]);
+	uv.y.Store(inputs[1]);
+	ddx.x.Store(inputs[2]);
+	ddx.y.Store(inputs[3]);
+	ddy.x.Store(inputs[4]);
+	ddy.y.Store(inputs[5]);
+
+	alignas(32) float channels[4][8];
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		const Vector4 rgba{ texture.SampleRGBA(Vector2{ inputs[0][lane], inputs[1][lane] }, Vector2{ inputs[2][lane], inputs[3][lane] },
+			Vector2{ inputs[4][lane], inputs[5][lane] }, filter, useMipmaps) };
+		channels[0][lane] = rgba.x;
+		channels[1][lane] = rgba.y;
+		channels[2][lane] = rgba.z;
+		channels[3][lane] = rgba.w;
+	}
+
+	return Vector4x8{ Float8::Load(channels[0]), Float8::Load(channels[1]), Float8::Load(channels[2]), Float8::Load(channels[3]) };
+}
+
+Int8 WideSampler<SIMD_TARGET>::TexelIndex(const LevelLanes& levels, const Int8& x, const Int8& y)
+{
+	const Int8 tileMask{ Texture::TILE_MASK };
+	const Int8 tileOrigin{ ~Texture::TILE_MASK };
+	const Int8 linear{ y * levels.width + x };
+	//Multiplying by TILE_SIZE (4) is a shift by 2
+	static_assert(Texture::TILE_SIZE == 4);
+	const Int8 tiled{ (y & tileOrigin) * levels.width + ((x & tileOrigin) << 2) + ((y & tileMask) << 2) + (x & tileMask) };
+	return levels.firstTexel + Int8::Select(levels.isTiled, linear, tiled);
+}
+
+Vector4x8 WideSampler<SIMD_TARGET>::UnpackTexels(const Int8& texels)
+{
+	const Int8 byteMask{ 0xFF };
+	const Float8 toUnit{ 255.f };
+	return Vector4x8{
+		(texels & byteMask).ToFloat() / toUnit,
+		((texels >> 8) & byteMask).ToFloat() / toUnit,
+		((texels >> 16) & byteMask).ToFloat() / toUnit,
+		(texels >> 24).ToFloat() / toUnit };
+}
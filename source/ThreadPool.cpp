@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int nrThreads)
+{
+	//The thread calling ParallelFor also works, so it counts as one of the threads
+	for (int i = 1; i < nrThreads; ++i)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_ShouldStop = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& job)
+{
+	if (m_Workers.empty() || count <= 1)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		m_pJob = &job;
+		m_JobCount = count;
+		m_NextJob = 0;
+		m_NrBusyWorkers = static_cast<int>(m_Workers.size());
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	RunJobs(job, count);
+
+	std::unique_lock<std::mutex> lock{ m_Mutex };
+	m_DoneCondition.wait(lock, [this]() { return m_NrBusyWorkers == 0; });
+	m_pJob = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t lastGeneration{ 0 };
+	while (true)
+	{
+		const std::function<void(int)>* pJob{};
+		int count{};
+		{
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_WakeCondition.wait(lock, [&]() { return m_ShouldStop || m_Generation != lastGeneration; });
+
+			if (m_ShouldStop)
+				return;
+
+			lastGeneration = m_Generation;
+			pJob = m_pJob;
+			count = m_JobCount;
+		}
+
+		RunJobs(*pJob, count);
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		if (--m_NrBusyWorkers == 0)
+		{
+			m_DoneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::RunJobs(const std::function<void(int)>& job, int count)
+{
+	//Jobs are handed out one by one, so uneven jobs (busy vs empty tiles) still balance out
+	for (int i = m_NextJob.fetch_add(1); i < count; i = m_NextJob.fetch_add(1))
+	{
+		job(i);
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+class ThreadPool final
+{
+public:
+	ThreadPool(int nrThreads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) noexcept = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+	//Calls job(i) for every i in [0, count), the calling thread helps out and only returns once every job is done
+	void ParallelFor(int count, const std::function<void(int)>& job);
+
+	//Worker threads + the calling thread
+	int GetNrThreads() const { return static_cast<int>(m_Workers.size()) + 1; }
+
+private:
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_DoneCondition;
+
+	const std::function<void(int)>* m_pJob{ nullptr };
+	std::atomic<int> m_NextJob{};
+	int m_JobCount{};
+	int m_NrBusyWorkers{};
+	uint64_t m_Generation{};
+	bool m_ShouldStop{ false };
+
+	void WorkerLoop();
+	void RunJobs(const std::function<void(int)>& job, int count);
+};
@@ -0,0 +1,427 @@
+#include "pch.h"
+#include "Utils.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+namespace
+{
+	using namespace dae;
+
+	//Smaller files are parsed as one block, splitting them costs more than it gains
+	constexpr size_t MIN_OBJ_BLOCK_SIZE{ 256 * 1024 };
+
+	//Relative (negative) face indices can point into earlier blocks, so while a block is parsed they are stored as
+	//RELATIVE_INDEX_BIAS + their index within the block and fixed up once the block's offset in the merged arrays is known
+	constexpr int32_t RELATIVE_INDEX_BIAS{ INT32_MIN / 2 };
+
+	//Position/uv/normal indices of one face corner, 1-based like in the file and 0 when the corner has no uv or normal
+	struct OBJCorner
+	{
+		int32_t iPosition;
+		int32_t iTexCoord;
+		int32_t iNormal;
+
+		bool operator==(const OBJCorner& other) const
+		{
+			return iPosition == other.iPosition && iTexCoord == other.iTexCoord && iNormal == other.iNormal;
+		}
+	};
+
+	struct OBJCornerHash
+	{
+		size_t operator()(const OBJCorner& corner) const
+		{
+			size_t hash{ static_cast<uint32_t>(corner.iPosition) };
+			hash = hash * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(corner.iTexCoord);
+			hash = hash * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(corner.iNormal);
+			return hash ^ (hash >> 29);
+		}
+	};
+
+	//Everything one block of lines defines, in file order
+	struct OBJBlock
+	{
+		std::vector<Vector3> positions;
+		std::vector<Vector2> UVs;
+		std::vector<Vector3> normals;
+		//3 per triangle, polygons are already fanned out
+		std::vector<OBJCorner> corners;
+		bool isValid{ true };
+	};
+
+	bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	void SkipBlanks(const char*& pCursor, const char* pEnd)
+	{
+		while (pCursor < pEnd && IsBlank(*pCursor))
+		{
+			++pCursor;
+		}
+	}
+
+	//from_chars doesn't skip whitespace or accept a leading '+', and is locale independent
+	template<typename T>
+	bool ParseNumber(const char*& pCursor, const char* pEnd, T& value)
+	{
+		if (pCursor < pEnd && *pCursor == '+')
+		{
+			++pCursor;
+		}
+
+		const auto [pNext, error] { std::from_chars(pCursor, pEnd, value) };
+		if (error == std::errc::result_out_of_range)
+		{
+			//A float too small for even a denormal is 0, one too big (or an index that overflows) is as broken as a typo.
+			//from_chars doesn't say which way the value fell out of range, double has the range to tell (beyond that it's rejected too)
+			if constexpr (std::is_floating_point_v<T>)
+			{
+				double wideValue{};
+				if (std::from_chars(pCursor, pEnd, wideValue).ec != std::errc{} || std::abs(wideValue) > std::numeric_limits<T>::max())
+					return false;
+
+				value = T{};
+			}
+			else
+			{
+				return false;
+			}
+		}
+		else if (error != std::errc{})
+		{
+			return false;
+		}
+
+		pCursor = pNext;
+		return true;
+	}
+
+	bool ParseFloats(const char*& pCursor, const char* pEnd, float* pValues, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			SkipBlanks(pCursor, pEnd);
+			if (!ParseNumber(pCursor, pEnd, pValues[i]))
+				return false;
+		}
+		return true;
+	}
+
+	//Reads one face index, nrDefined is how many of that element the block has defined so far
+	bool ParseFaceIndex(const char*& pCursor, const char* pEnd, size_t nrDefined, int32_t& index)
+	{
+		if (!ParseNumber(pCursor, pEnd, index) || index == 0)
+			return false;
+
+		if (index < 0)
+		{
+			index += RELATIVE_INDEX_BIAS + static_cast<int32_t>(nrDefined);
+		}
+		return true;
+	}
+
+	//Turns an index of ParseFaceIndex into a 1-based index in the merged array, blockOffset is where the block's elements start in there
+	int32_t ResolveFaceIndex(int32_t index, size_t blockOffset)
+	{
+		return index >= 0 ? index : static_cast<int32_t>(blockOffset) + (index - RELATIVE_INDEX_BIAS) + 1;
+	}
+
+	void ParseOBJBlock(const char* pBegin, const char* pEnd, OBJBlock& block)
+	{
+		std::vector<OBJCorner> polygon{};
+
+		const char* pLine{ pBegin };
+		while (pLine < pEnd)
+		{
+			const char* pLineEnd{ static_cast<const char*>(memchr(pLine, '\n', pEnd - pLine)) };
+			if (pLineEnd == nullptr)
+			{
+				pLineEnd = pEnd;
+			}
+
+			const char* pCursor{ pLine };
+			pLine = pLineEnd + 1;
+
+			SkipBlanks(pCursor, pLineEnd);
+			const char* pKeyword{ pCursor };
+			while (pCursor < pLineEnd && !IsBlank(*pCursor))
+			{
+				++pCursor;
+			}
+			const std::string_view keyword{ pKeyword, static_cast<size_t>(pCursor - pKeyword) };
+
+			if (keyword == "v")
+			{
+				//Vertex
+				float xyz[3];
+				block.isValid &= ParseFloats(pCursor, pLineEnd, xyz, 3);
+				block.positions.emplace_back(xyz[0], xyz[1], xyz[2]);
+			}
+			else if (keyword == "vt")
+			{
+				//Vertex TexCoord, v is optional
+				float uv[2]{};
+				block.isValid &= ParseFloats(pCursor, pLineEnd, uv, 1);
+				ParseFloats(pCursor, pLineEnd, uv + 1, 1);
+				block.UVs.emplace_back(uv[0], 1 - uv[1]);
+			}
+			else if (keyword == "vn")
+			{
+				//Vertex Normal
+				float xyz[3];
+				block.isValid &= ParseFloats(pCursor, pLineEnd, xyz, 3);
+				block.normals.emplace_back(xyz[0], xyz[1], xyz[2]);
+			}
+			else if (keyword == "f")
+			{
+				//Face: v, v/vt, v//vn or v/vt/vn per corner
+				polygon.clear();
+				SkipBlanks(pCursor, pLineEnd);
+				while (pCursor < pLineEnd)
+				{
+					OBJCorner corner{};
+					block.isValid &= ParseFaceIndex(pCursor, pLineEnd, block.positions.size(), corner.iPosition);
+
+					if (pCursor < pLineEnd && *pCursor == '/')
+					{
+						++pCursor;
+						if (pCursor < pLineEnd && *pCursor != '/')
+						{
+							block.isValid &= ParseFaceIndex(pCursor, pLineEnd, block.UVs.size(), corner.iTexCoord);
+						}
+
+						if (pCursor < pLineEnd && *pCursor == '/')
+						{
+							++pCursor;
+							block.isValid &= ParseFaceIndex(pCursor, pLineEnd, block.normals.size(), corner.iNormal);
+						}
+					}
+
+					if (!block.isValid)
+						return;
+
+					polygon.push_back(corner);
+					SkipBlanks(pCursor, pLineEnd);
+				}
+
+				if (polygon.size() < 3)
+				{
+					block.isValid = false;
+					return;
+				}
+
+				//Quads and n-gons become a fan around their first corner
+				for (size_t i = 1; i + 1 < polygon.size(); ++i)
+				{
+					block.corners.push_back(polygon[0]);
+					block.corners.push_back(polygon[i]);
+					block.corners.push_back(polygon[i + 1]);
+				}
+			}
+			//Comments, groups, materials, ... are skipped
+
+			if (!block.isValid)
+				return;
+		}
+	}
+}
+
+namespace dae
+{
+	namespace Utils
+	{
+		bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding, bool weldVertices)
+		{
+			vertices.clear();
+			indices.clear();
+
+			const MappedFile file{ filename };
+			if (file.GetData() == nullptr)
+				return false;
+
+			const char* pData{ reinterpret_cast<const char*>(file.GetData()) };
+			const char* pDataEnd{ pData + file.GetSize() };
+
+			//A few blocks per thread so uneven blocks still balance out, every block ends right after a newline
+			const int nrThreads{ std::max(1, static_cast<int>(std::thread::hardware_concurrency())) };
+			const size_t blockSize{ std::max(MIN_OBJ_BLOCK_SIZE, file.GetSize() / (nrThreads * 4)) };
+			std::vector<const char*> blockStarts{ pData };
+			while (static_cast<size_t>(pDataEnd - blockStarts.back()) > blockSize)
+			{
+				const char* pSplit{ blockStarts.back() + blockSize };
+				const char* pNewline{ static_cast<const char*>(memchr(pSplit, '\n', pDataEnd - pSplit)) };
+				if (pNewline == nullptr)
+					break;
+
+				blockStarts.push_back(pNewline + 1);
+			}
+			blockStarts.push_back(pDataEnd);
+
+			const int nrBlocks{ static_cast<int>(blockStarts.size()) - 1 };
+			std::vector<OBJBlock> blocks(nrBlocks);
+			ThreadPool threadPool{ nrBlocks > 1 ? nrThreads : 1 };
+			threadPool.ParallelFor(nrBlocks, [&](int blockIdx)
+				{
+					ParseOBJBlock(blockStarts[blockIdx], blockStarts[blockIdx + 1], blocks[blockIdx]);
+				});
+
+			//Where every block's elements start in the merged arrays
+			std::vector<size_t> positionOffsets(nrBlocks + 1, 0);
+			std::vector<size_t> UVOffsets(nrBlocks + 1, 0);
+			std::vector<size_t> normalOffsets(nrBlocks + 1, 0);
+			std::vector<size_t> cornerOffsets(nrBlocks + 1, 0);
+			for (int blockIdx = 0; blockIdx < nrBlocks; ++blockIdx)
+			{
+				const OBJBlock& block{ blocks[blockIdx] };
+				if (!block.isValid)
+					return false;
+
+				positionOffsets[blockIdx + 1] = positionOffsets[blockIdx] + block.positions.size();
+				UVOffsets[blockIdx + 1] = UVOffsets[blockIdx] + block.UVs.size();
+				normalOffsets[blockIdx + 1] = normalOffsets[blockIdx] + block.normals.size();
+				cornerOffsets[blockIdx + 1] = cornerOffsets[blockIdx] + block.corners.size();
+			}
+
+			std::vector<Vector3> positions(positionOffsets.back());
+			std::vector<Vector2> UVs(UVOffsets.back());
+			std::vector<Vector3> normals(normalOffsets.back());
+			std::vector<OBJCorner> corners(cornerOffsets.back());
+			std::atomic<bool> areIndicesValid{ true };
+
+			threadPool.ParallelFor(nrBlocks, [&](int blockIdx)
+				{
+					const OBJBlock& block{ blocks[blockIdx] };
+					std::copy(block.positions.begin(), block.positions.end(), positions.begin() + positionOffsets[blockIdx]);
+					std::copy(block.UVs.begin(), block.UVs.end(), UVs.begin() + UVOffsets[blockIdx]);
+					std::copy(block.normals.begin(), block.normals.end(), normals.begin() + normalOffsets[blockIdx]);
+
+					for (size_t i = 0; i < block.corners.size(); ++i)
+					{
+						OBJCorner corner{ block.corners[i] };
+						corner.iPosition = ResolveFaceIndex(corner.iPosition, positionOffsets[blockIdx]);
+						corner.iTexCoord = ResolveFaceIndex(corner.iTexCoord, UVOffsets[blockIdx]);
+						corner.iNormal = ResolveFaceIndex(corner.iNormal, normalOffsets[blockIdx]);
+
+						if (corner.iPosition <= 0 || corner.iPosition > static_cast<int32_t>(positions.size())
+							|| corner.iTexCoord < 0 || corner.iTexCoord > static_cast<int32_t>(UVs.size())
+							|| corner.iNormal < 0 || corner.iNormal > static_cast<int32_t>(normals.size()))
+						{
+							areIndicesValid = false;
+						}
+						corners[cornerOffsets[blockIdx] + i] = corner;
+					}
+				});
+
+			blocks.clear();
+			if (!areIndicesValid)
+				return false;
+
+			auto makeVertex = [&](const OBJCorner& corner)
+				{
+					// OBJ format uses 1-based arrays
+					Vertex vertex{};
+					vertex.Position = positions[corner.iPosition - 1];
+					if (corner.iTexCoord > 0)
+					{
+						vertex.Uv = UVs[corner.iTexCoord - 1];
+					}
+					if (corner.iNormal > 0)
+					{
+						vertex.Normal = normals[corner.iNormal - 1];
+					}
+					return vertex;
+				};
+
+			//Where each corner of a triangle goes in the index buffer, 0 2 1 flips the winding
+			const size_t cornerSlots[3]{ 0, flipAxisAndWinding ? 2u : 1u, flipAxisAndWinding ? 1u : 2u };
+			indices.resize(corners.size());
+
+			if (weldVertices)
+			{
+				//Maps a face corner to the vertex that was made for it
+				std::unordered_map<OBJCorner, uint32_t, OBJCornerHash> weldedVertices{};
+				weldedVertices.reserve(positions.size());
+
+				for (size_t i = 0; i < corners.size(); i += 3)
+				{
+					for (size_t c = 0; c < 3; ++c)
+					{
+						const auto [it, isNew] { weldedVertices.try_emplace(corners[i + c], static_cast<uint32_t>(vertices.size())) };
+						if (isNew)
+						{
+							vertices.push_back(makeVertex(corners[i + c]));
+						}
+						indices[i + cornerSlots[c]] = it->second;
+					}
+				}
+			}
+			else
+			{
+				//Every face corner gets its own vertex, in file order
+				vertices.resize(corners.size());
+				threadPool.ParallelFor(nrBlocks, [&](int blockIdx)
+					{
+						for (size_t i = cornerOffsets[blockIdx]; i < cornerOffsets[blockIdx + 1]; i += 3)
+						{
+							for (size_t c = 0; c < 3; ++c)
+							{
+								vertices[i + c] = makeVertex(corners[i + c]);
+								indices[i + cornerSlots[c]] = static_cast<uint32_t>(i + c);
+							}
+						}
+					});
+			}
+
+			//Cheap Tangent Calculations
+			//Welded vertices sum the tangents of every triangle that shares them
+			for (uint32_t i = 0; i < indices.size(); i += 3)
+			{
+				uint32_t index0 = indices[i];
+				uint32_t index1 = indices[size_t(i) + 1];
+				uint32_t index2 = indices[size_t(i) + 2];
+
+				const Vector3& p0 = vertices[index0].Position;
+				const Vector3& p1 = vertices[index1].Position;
+				const Vector3& p2 = vertices[index2].Position;
+				const Vector2& uv0 = vertices[index0].Uv;
+				const Vector2& uv1 = vertices[index1].Uv;
+				const Vector2& uv2 = vertices[index2].Uv;
+
+				const Vector3 edge0 = p1 - p0;
+				const Vector3 edge1 = p2 - p0;
+				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
+				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
+				float r = 1.f / Vector2::Cross(diffX, diffY);
+
+				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
+				vertices[index0].Tangent += tangent;
+				vertices[index1].Tangent += tangent;
+				vertices[index2].Tangent += tangent;
+			}
+
+			//Create the Tangents (reject)
+			for (auto& v : vertices)
+			{
+				v.Tangent = Vector3::Reject(v.Tangent, v.Normal).Normalized();
+
+				if(flipAxisAndWinding)
+				{
+					v.Position.z *= -1.f;
+					v.Normal.z *= -1.f;
+					v.Tangent.z *= -1.f;
+				}
+			}
+
+			return true;
+		}
+	}
+}
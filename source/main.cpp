@@ -6,6 +6,7 @@
 
 #undef main
 #include "Renderer.h"
+#include "CpuFeatures.h"
 
 using namespace dae;
 
@@ -15,11 +16,47 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
+//The newest SIMD level the CPU supports, or the one "--simd <sse4|avx2|avx512>" asks for when the CPU has it.
+//False when the CPU has none of them, the kernels can't run at all then
+bool SelectSimdLevel(int argc, char* args[], SimdLevel& level)
+{
+	SimdLevel highestLevel{};
+	if (!CpuFeatures::GetHighestSupportedLevel(highestLevel))
+		return false;
+
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (std::string{ args[i] } != "--simd")
+			continue;
+
+		SimdLevel forcedLevel{};
+		if (!CpuFeatures::ParseLevel(args[i + 1], forcedLevel))
+		{
+			std::cout << "**(SOFTWARE) Unknown SIMD level \"" << args[i + 1] << "\", expected sse4, avx2 or avx512\n";
+		}
+		else if (!CpuFeatures::IsSupported(forcedLevel))
+		{
+			std::cout << "**(SOFTWARE) --simd " << CpuFeatures::GetName(forcedLevel) << " isn't supported by this CPU, using " << CpuFeatures::GetName(highestLevel) << '\n';
+		}
+		else
+		{
+			std::cout << "**(SOFTWARE) SIMD level forced to " << CpuFeatures::GetName(forcedLevel) << '\n';
+			level = forcedLevel;
+			return true;
+		}
+	}
+	level = highestLevel;
+	return true;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	SimdLevel simdLevel{};
+	if (!SelectSimdLevel(argc, args, simdLevel))
+	{
+		std::cout << "**(SOFTWARE) This CPU doesn't support SSE4.1, the software rasterizer needs it\n";
+		return 1;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -39,7 +76,14 @@ int main(int argc, char* args[])
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
+	const auto pRenderer = new Renderer(pWindow, simdLevel);
+	if (!pRenderer->IsMeshLoaded())
+	{
+		delete pRenderer;
+		delete pTimer;
+		ShutDown(pWindow);
+		return 1;
+	}
 
 	//Start loop
 	pTimer->Start();
@@ -93,7 +137,7 @@ int main(int argc, char* args[])
 				}
 				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
 				{
-					//Culling
+					pRenderer->CycleCullMode();
 				}
 				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
 				{
@@ -103,6 +147,58 @@ int main(int argc, char* args[])
 				{
 					shouldPrintFPS = pRenderer->TogglePrintFPS();
 				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_1)
+				{
+					pRenderer->ToggleTiledRasterization();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_2)
+				{
+					pRenderer->CycleThreadCount();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_3)
+				{
+					pRenderer->ToggleSIMDCoverage();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_4)
+				{
+					pRenderer->CycleTraversalMode();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_5)
+				{
+					pRenderer->ToggleHiZCulling();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_6)
+				{
+					pRenderer->ToggleVisibilityBufferShading();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_7)
+				{
+					pRenderer->ToggleFixedPointRasterization();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_8)
+				{
+					pRenderer->CycleVertexChunkSize();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_9)
+				{
+					pRenderer->ToggleMipmapping();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_0)
+				{
+					pRenderer->BenchmarkTextureSampling();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F)
+				{
+					pRenderer->ToggleFastMath();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_V)
+				{
+					pRenderer->ValidateFastMath();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_G)
+				{
+					pRenderer->ToggleWideShading();
+				}
 				break;
 			default: ;
 			}
@@ -123,6 +219,7 @@ int main(int argc, char* args[])
 			{
 				printTimer = 0.f;
 				std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+				pRenderer->PrintStats();
 			}
 		}
 		